@@ -0,0 +1,1226 @@
+#ifndef EX3_AHOCORASICK_HPP
+#define EX3_AHOCORASICK_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "HashMap.hpp"
+#include "MappedFile.hpp"
+#include "Simd.hpp"
+
+/**
+ * Defines the number of values of a byte.
+ */
+const int ALPHABET_SIZE = 256;
+/**
+ * Defines the root state of the automaton.
+ */
+const int ROOT_STATE = 0;
+/**
+ * Defines the transition of a state that has no edge for a byte.
+ */
+const int32_t NO_EDGE = -1;
+/**
+ * Defines the default maximal number of cells in the dense transition table.
+ */
+const int64_t DEF_DENSE_LIMIT = 1 << 22;
+/**
+ * Defines the maximal number of different first bytes of the phrases, for which a scan looks for
+ * the next first byte when it's in the root state instead of moving through the automaton.
+ */
+const int PREFILTER_MAX_BYTES = 16;
+/**
+ * Defines the smallest dense transition table (in bytes) for which a scan in the root state jumps
+ * over the pairs of bytes no phrase starts with. A smaller table stays in the cache, and its
+ * lookup costs about as much as testing a pair.
+ */
+const size_t PAIR_FILTER_MIN_TABLE = 1 << 18;
+/**
+ * Defines the largest part of the pairs of lower case letters (most of the bytes of a text) that
+ * the phrases may start with, for which a scan in the root state tests the pairs of bytes. If the
+ * phrases start with more of them, the tests keep stopping the scan, and cost more than the
+ * lookups of the root they save.
+ */
+const double PAIR_FILTER_MAX_DENSITY = 0.05;
+/**
+ * Defines the number of lower case letters.
+ */
+const int LOWER_CASE_LETTERS = 'z' - 'a' + 1;
+/**
+ * Defines the number of 64 bit words of a bitset of all the pairs of bytes.
+ */
+const size_t PAIR_WORDS = ALPHABET_SIZE * ALPHABET_SIZE / 64;
+/**
+ * Defines the number of pairs of bytes a scan in the root state tests together before it looks
+ * for the one that may start a phrase.
+ */
+const size_t PAIR_CHUNK = 16;
+/**
+ * Defines the first bytes of a compiled spam database.
+ */
+const char IMAGE_MAGIC[8] = {'E', 'X', '3', 'S', 'P', 'A', 'M', '\0'};
+/**
+ * Defines the version of the compiled spam database format.
+ */
+const uint32_t IMAGE_VERSION = 3;
+/**
+ * Defines the flag of a compiled spam database whose phrases all have non-negative scores.
+ */
+const uint64_t IMAGE_NON_NEGATIVE = 1;
+/**
+ * Defines a value that is stored in a compiled spam database to detect a different byte order.
+ */
+const uint32_t IMAGE_BYTE_ORDER = 0x01020304;
+/**
+ * Defines the alignment of every section of a compiled spam database.
+ */
+const size_t IMAGE_ALIGN = 8;
+/**
+ * Defines a massage for an invalid compiled spam database.
+ */
+const char* INVALID_IMAGE = "Invalid compiled spam database";
+
+/**
+ * Change the given ASCII byte to lower case, like tolower in the "C" locale.
+ * @param c The byte to change.
+ * @return The lower case byte.
+ */
+inline unsigned char foldByte(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (unsigned char) (c - 'A' + 'a') : c;
+}
+
+/**
+ * A read-only view of an array, that is owned by a vector or lives in a mapped file.
+ * @tparam T The type of the elements.
+ */
+template <typename T>
+class ArrayView
+{
+    const T *_data;
+    size_t _size;
+
+public:
+
+    /**
+     * Constructor of an empty view.
+     */
+    ArrayView() :
+        _data(nullptr),
+        _size(0)
+    {
+    }
+
+    /**
+     * Constructor.
+     * @param data The first element.
+     * @param size The number of elements.
+     */
+    ArrayView(const T *data, size_t size) :
+        _data(data),
+        _size(size)
+    {
+    }
+
+    /**
+     * @param index The index of an element.
+     * @return The element.
+     */
+    const T& operator[](size_t index) const
+    {
+        return _data[index];
+    }
+
+    /**
+     * @return The first element.
+     */
+    const T *data() const
+    {
+        return _data;
+    }
+
+    /**
+     * @return The number of elements.
+     */
+    size_t size() const
+    {
+        return _size;
+    }
+
+    /**
+     * @return True if the view has no elements, false otherwise.
+     */
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    /**
+     * @return The first element.
+     */
+    const T *begin() const
+    {
+        return _data;
+    }
+
+    /**
+     * @return The end of the elements.
+     */
+    const T *end() const
+    {
+        return _data + _size;
+    }
+
+};
+
+/**
+ * Aho-Corasick automaton of spam phrases, that scores a text in one pass over it.
+ * The automaton is a trie of the lower case phrases with failure links. Every state has the total
+ * score of the phrases that end when it is reached (its own phrase and the phrases of its chain of
+ * failure links), so the score of a text is the sum of the scores of the states it passes through,
+ * which counts every occurrence of every phrase, overlapping occurrences included. Every state also
+ * knows the phrases that end in it, so a scan can report which phrases it found and where.
+ * The trie edges are kept sorted in flat arrays. If the automaton is small enough it is also
+ * compiled to a dense table of its full transition function over byte classes (the bytes that
+ * appear in no phrase share one class), so a text byte costs one table lookup.
+ * A scan in the root state jumps to the next pair of bytes that starts a phrase (or the next byte
+ * that is a whole phrase), since nothing can match before it: the pairs are kept in a bitset of
+ * all the pairs of bytes, that is tested many pairs at once. When the phrases start with only a
+ * few different bytes, the scan first jumps with a SIMD search to the next one of them. The pairs
+ * are tested only if it's cheaper than moving through the automaton: when the phrases start with a
+ * few bytes, or when the transition table doesn't fit in the cache.
+ * All the arrays are read through views, so an automaton can be saved to a compiled spam database
+ * and used later straight from the mapped file, without building or copying anything.
+ */
+class AhoCorasick
+{
+    /**
+     * The arrays of an automaton that was built in memory.
+     */
+    struct Tables
+    {
+        std::vector<int32_t> edgeStart;
+        std::vector<unsigned char> edgeLabel;
+        std::vector<int32_t> edgeTarget;
+        std::vector<int32_t> fail;
+        std::vector<int64_t> score;
+        std::vector<int32_t> rootNext;
+        std::vector<unsigned char> byteClass;
+        std::vector<int32_t> dense;
+        std::vector<int64_t> phraseScore;
+        std::vector<uint64_t> phraseStart;
+        std::vector<char> phraseText;
+        std::vector<int32_t> outputStart;
+        std::vector<int32_t> outputPhrase;
+        std::vector<int32_t> outputLink;
+    };
+
+    /**
+     * The sections of a compiled spam database, in the order of the Tables arrays.
+     */
+    enum Section
+    {
+        EDGE_START, EDGE_LABEL, EDGE_TARGET, FAIL, SCORE, ROOT_NEXT, BYTE_CLASS, DENSE,
+        PHRASE_SCORE, PHRASE_START, PHRASE_TEXT, OUTPUT_START, OUTPUT_PHRASE, OUTPUT_LINK,
+        SECTIONS
+    };
+
+    /**
+     * The header of a compiled spam database. Every section is found by its offset from the start
+     * of the file and its number of elements, so the file can be mapped at any address.
+     */
+    struct ImageHeader
+    {
+        char magic[sizeof(IMAGE_MAGIC)];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t fileSize;
+        uint64_t checksum;
+        int64_t emptyScore;
+        int64_t maxStateScore;
+        uint64_t flags;
+        int32_t states;
+        int32_t classes;
+        uint64_t sections[SECTIONS][2];
+    };
+
+    int _states;
+    int64_t _emptyScore;
+    int64_t _maxStateScore;
+    bool _nonNegative;
+    // The edges of state s are _edgeLabel/_edgeTarget[_edgeStart[s] .. _edgeStart[s + 1]).
+    ArrayView<int32_t> _edgeStart;
+    ArrayView<unsigned char> _edgeLabel;
+    ArrayView<int32_t> _edgeTarget;
+    ArrayView<int32_t> _fail;
+    ArrayView<int64_t> _score;
+    ArrayView<int32_t> _rootNext;
+    // The dense table, where the transition of state s with byte c is
+    // _dense[s * _classes + _byteClass[c]]. Empty if the automaton is too large.
+    int _classes;
+    ArrayView<unsigned char> _byteClass;
+    ArrayView<int32_t> _dense;
+    // The phrases as they are in the spam file, where phrase i is
+    // _phraseText[_phraseStart[i] .. _phraseStart[i + 1]).
+    ArrayView<int64_t> _phraseScore;
+    ArrayView<uint64_t> _phraseStart;
+    ArrayView<char> _phraseText;
+    // The phrases that end in state s are _outputPhrase[_outputStart[s] .. _outputStart[s + 1]),
+    // and _outputLink[s] is the nearest state in its chain of failure links that has phrases of its
+    // own (or the root), so all the phrases that end in a state are found without the other
+    // states of the chain.
+    ArrayView<int32_t> _outputStart;
+    ArrayView<int32_t> _outputPhrase;
+    ArrayView<int32_t> _outputLink;
+    Tables _tables;
+    MappedFile _image;
+    ByteSet _firstBytes;
+    bool _prefilter;
+    bool _pairFilter;
+    // Bit (a << 8 | b) is set if a phrase starts with the bytes a, b, or if a is a whole phrase.
+    std::vector<uint64_t> _pairBits;
+
+    /**
+     * Find the first bytes and the first pairs of bytes of the phrases (from the first two levels
+     * of the trie), and decide if a scan should look for the first bytes with a SIMD search.
+     */
+    void _bindPrefilter()
+    {
+        _firstBytes = ByteSet();
+        _pairBits.assign(PAIR_WORDS, 0);
+        for (int c = 0; c < ALPHABET_SIZE; c++)
+        {
+            int32_t first = _rootNext[c];
+            if (first == NO_EDGE)
+            {
+                continue;
+            }
+            _firstBytes.add((unsigned char) c);
+            if (_outputStart[first] != _outputStart[first + 1])
+            {
+                // A phrase of one byte matches whatever byte follows it.
+                std::fill_n(&_pairBits[(size_t) c * ALPHABET_SIZE / 64], ALPHABET_SIZE / 64,
+                            ~(uint64_t) 0);
+            }
+            for (int32_t i = _edgeStart[first]; i < _edgeStart[first + 1]; i++)
+            {
+                size_t pair = (size_t) c << 8 | _edgeLabel[i];
+                _pairBits[pair / 64] |= (uint64_t) 1 << (pair % 64);
+            }
+        }
+        int letterPairs = 0;
+        for (unsigned char pair[2] = {'a', 'a'}; pair[0] <= 'z'; pair[0]++)
+        {
+            for (pair[1] = 'a'; pair[1] <= 'z'; pair[1]++)
+            {
+                letterPairs += _pairAt(pair, 0) != 0;
+            }
+        }
+        bool largeTable = _dense.empty() ||
+                          _dense.size() * sizeof(int32_t) >= PAIR_FILTER_MIN_TABLE;
+        _prefilter = _firstBytes.count <= PREFILTER_MAX_BYTES;
+        double density = (double) letterPairs / (LOWER_CASE_LETTERS * LOWER_CASE_LETTERS);
+        _pairFilter = _prefilter || (largeTable && density <= PAIR_FILTER_MAX_DENSITY);
+    }
+
+    /**
+     * @param bytes A text.
+     * @param i An index of a byte of the text, that has a byte after it.
+     * @return Not 0 if a phrase may start at this byte, 0 otherwise.
+     */
+    uint64_t _pairAt(const unsigned char *bytes, size_t i) const
+    {
+        size_t pair = (size_t) bytes[i] << 8 | bytes[i + 1];
+        return _pairBits[pair / 64] & ((uint64_t) 1 << (pair % 64));
+    }
+
+    /**
+     * Find the next byte of a text a phrase may start at, for a scan in the root state. The last
+     * byte of the text, whose next byte isn't known yet, may start a phrase if it's a first byte.
+     * @tparam FindFirst True to jump to the next first byte of a phrase with a SIMD search.
+     * @param bytes The text.
+     * @param i The index to start from.
+     * @param length The length of the text.
+     * @return The index of the byte, or length if there is none.
+     */
+    template <bool FindFirst>
+    size_t _nextCandidate(const unsigned char *bytes, size_t i, size_t length) const
+    {
+        // Most of the time a phrase may start right away, so the first pairs are tested one by one.
+        for (size_t end = std::min(length, i + PAIR_CHUNK) - 1; i < end; i++)
+        {
+            if (_pairAt(bytes, i) != 0)
+            {
+                return i;
+            }
+        }
+        while (i + 1 < length)
+        {
+            if (FindFirst)
+            {
+                i += findByteOfSet(bytes + i, length - 1 - i, _firstBytes);
+            }
+            else
+            {
+                // A chunk is tested with one OR of its pairs, and only a chunk with a hit is
+                // tested again for the mask of its hits, whose lowest bit is the first one.
+                for ( ; i + PAIR_CHUNK < length; i += PAIR_CHUNK)
+                {
+                    uint64_t any = 0;
+                    for (size_t k = 0; k < PAIR_CHUNK; k++)
+                    {
+                        any |= _pairAt(bytes, i + k);
+                    }
+                    if (any != 0)
+                    {
+                        uint32_t hits = 0;
+                        for (size_t k = 0; k < PAIR_CHUNK; k++)
+                        {
+                            hits |= (uint32_t) (_pairAt(bytes, i + k) != 0) << k;
+                        }
+                        return i + (size_t) __builtin_ctz(hits);
+                    }
+                }
+            }
+            if (i + 1 >= length)
+            {
+                break;
+            }
+            if (_pairAt(bytes, i) != 0)
+            {
+                return i;
+            }
+            i++;
+        }
+        return i < length && _firstBytes.contains[bytes[i]] ? i : length;
+    }
+
+    /**
+     * Scan a text with the given transition function. In the root state the scan may jump to the
+     * next byte a phrase may start at; the bytes it jumps over would only lead back to the root
+     * state.
+     * @tparam Skip True to jump over the bytes no phrase may start at.
+     * @tparam FindFirst True to jump to the next first byte of a phrase with a SIMD search.
+     * @param bytes The text.
+     * @param length The length of the text.
+     * @param state The state of the scan, updated to the state after the text.
+     * @param step A function that gets a state and a byte and returns the next state.
+     * @param visit A function that gets every state the scan reaches, and the index of the byte
+     * after the one that led to it.
+     * @param skipped Increased by the number of bytes the scan jumped over.
+     * @return The score of the phrases that end in the text.
+     */
+    template <bool Skip, bool FindFirst, typename Step, typename Visit>
+    int64_t _scanWith(const unsigned char *bytes, size_t length, int32_t& state, Step step,
+                      Visit visit, size_t& skipped) const
+    {
+        const int64_t *stateScore = _score.data();
+        int64_t score = 0;
+        int32_t cur = state;
+        for (size_t i = 0; i < length; i++)
+        {
+            if (Skip && cur == ROOT_STATE)
+            {
+                size_t next = _nextCandidate<FindFirst>(bytes, i, length);
+                skipped += next - i;
+                i = next;
+                if (i == length)
+                {
+                    break;
+                }
+            }
+            cur = step(cur, bytes[i]);
+            score += stateScore[cur];
+            visit(cur, i + 1);
+        }
+        state = cur;
+        return score;
+    }
+
+    /**
+     * Scan a text with the given transition function, and the prefilter the automaton uses.
+     * @param bytes The text.
+     * @param length The length of the text.
+     * @param state The state of the scan, updated to the state after the text.
+     * @param step A function that gets a state and a byte and returns the next state.
+     * @param visit A function that gets every state the scan reaches (see _scanWith).
+     * @param skipped Increased by the number of bytes the scan jumped over.
+     * @return The score of the phrases that end in the text.
+     */
+    template <typename Step, typename Visit>
+    int64_t _scanWithFilter(const unsigned char *bytes, size_t length, int32_t& state, Step step,
+                            Visit visit, size_t& skipped) const
+    {
+        if (_prefilter)
+        {
+            return _scanWith<true, true>(bytes, length, state, step, visit, skipped);
+        }
+        if (_pairFilter)
+        {
+            return _scanWith<true, false>(bytes, length, state, step, visit, skipped);
+        }
+        return _scanWith<false, false>(bytes, length, state, step, visit, skipped);
+    }
+
+    /**
+     * Continue a scan of a text with its next part, with the transition function of the automaton.
+     * @param text The next part of the text, in lower case.
+     * @param length The length of the part.
+     * @param state The state of the scan, updated to the state after this part.
+     * @param visit A function that gets every state the scan reaches (see _scanWith).
+     * @param skipped Increased by the number of bytes the scan jumped over.
+     * @return The score of the phrases that end in this part (without empty phrases).
+     */
+    template <typename Visit>
+    int64_t _scan(const char *text, size_t length, int32_t& state, Visit visit,
+                  size_t& skipped) const
+    {
+        const unsigned char *bytes = (const unsigned char *) text;
+        if (dense())
+        {
+            const int32_t *table = _dense.data();
+            const unsigned char *byteClass = _byteClass.data();
+            size_t classes = (size_t) _classes;
+            auto step = [=](int32_t cur, unsigned char c)
+            {
+                return table[(size_t) cur * classes + byteClass[c]];
+            };
+            return _scanWithFilter(bytes, length, state, step, visit, skipped);
+        }
+        auto step = [this](int32_t cur, unsigned char c)
+        {
+            return _next(cur, c);
+        };
+        return _scanWithFilter(bytes, length, state, step, visit, skipped);
+    }
+
+    /**
+     * Point all the views to the arrays of the automaton that was built in memory.
+     */
+    void _bindTables()
+    {
+        _edgeStart = ArrayView<int32_t>(_tables.edgeStart.data(), _tables.edgeStart.size());
+        _edgeLabel = ArrayView<unsigned char>(_tables.edgeLabel.data(), _tables.edgeLabel.size());
+        _edgeTarget = ArrayView<int32_t>(_tables.edgeTarget.data(), _tables.edgeTarget.size());
+        _fail = ArrayView<int32_t>(_tables.fail.data(), _tables.fail.size());
+        _score = ArrayView<int64_t>(_tables.score.data(), _tables.score.size());
+        _rootNext = ArrayView<int32_t>(_tables.rootNext.data(), _tables.rootNext.size());
+        _byteClass = ArrayView<unsigned char>(_tables.byteClass.data(), _tables.byteClass.size());
+        _dense = ArrayView<int32_t>(_tables.dense.data(), _tables.dense.size());
+        _phraseScore = ArrayView<int64_t>(_tables.phraseScore.data(), _tables.phraseScore.size());
+        _phraseStart = ArrayView<uint64_t>(_tables.phraseStart.data(), _tables.phraseStart.size());
+        _phraseText = ArrayView<char>(_tables.phraseText.data(), _tables.phraseText.size());
+        _outputStart = ArrayView<int32_t>(_tables.outputStart.data(), _tables.outputStart.size());
+        _outputPhrase = ArrayView<int32_t>(_tables.outputPhrase.data(),
+                                           _tables.outputPhrase.size());
+        _outputLink = ArrayView<int32_t>(_tables.outputLink.data(), _tables.outputLink.size());
+    }
+
+    /**
+     * @param state A state of the automaton.
+     * @param c A byte.
+     * @return The state the trie edge of this byte leads to, or NO_EDGE.
+     */
+    int32_t _edge(int32_t state, unsigned char c) const
+    {
+        if (state == ROOT_STATE)
+        {
+            return _rootNext[c];
+        }
+        for (int32_t i = _edgeStart[state]; i < _edgeStart[state + 1]; i++)
+        {
+            if (_edgeLabel[i] == c)
+            {
+                return _edgeTarget[i];
+            }
+        }
+        return NO_EDGE;
+    }
+
+    /**
+     * @param state A state of the automaton.
+     * @param c A byte.
+     * @return The state the automaton moves to from the given state on the given byte.
+     */
+    int32_t _next(int32_t state, unsigned char c) const
+    {
+        while (true)
+        {
+            int32_t target = _edge(state, c);
+            if (target != NO_EDGE)
+            {
+                return target;
+            }
+            if (state == ROOT_STATE)
+            {
+                return ROOT_STATE;
+            }
+            state = _fail[state];
+        }
+    }
+
+    /**
+     * Build the trie of the given phrases into the flat edge arrays, and keep the phrases and the
+     * state every phrase ends in.
+     * @param phrases Map of phrases and their scores.
+     * @param terminal Set to the total score of the phrases that end in every state.
+     */
+    template <typename Map>
+    void _buildTrie(const Map& phrases, std::vector<int64_t>& terminal)
+    {
+        // Edges are first kept in a map from (state, byte) to the target state.
+        HashMap<uint64_t, int32_t> edges;
+        size_t phraseBytes = 0;
+        for (const auto& phrase : phrases)
+        {
+            phraseBytes += phrase.first.size();
+        }
+        // Every byte of a phrase adds at most one edge.
+        edges.reserve((int) std::min(phraseBytes, (size_t) INT32_MAX / 2));
+        _tables.phraseText.reserve(phraseBytes);
+        _tables.phraseScore.reserve(phrases.size());
+        _tables.phraseStart.reserve(phrases.size() + 1);
+        std::vector<int32_t> edgeCount(1, 0);
+        // The state every phrase ends in, or ROOT_STATE for an empty phrase.
+        std::vector<int32_t> phraseState;
+        phraseState.reserve(phrases.size());
+        terminal.assign(1, 0);
+        _tables.phraseStart.push_back(0);
+        for (const auto& phrase : phrases)
+        {
+            _tables.phraseText.insert(_tables.phraseText.end(), phrase.first.begin(),
+                                      phrase.first.end());
+            _tables.phraseStart.push_back(_tables.phraseText.size());
+            _tables.phraseScore.push_back(phrase.second);
+            _nonNegative = _nonNegative && phrase.second >= 0;
+            if (phrase.first.empty())
+            {
+                _emptyScore += phrase.second;
+                phraseState.push_back(ROOT_STATE);
+                continue;
+            }
+            int32_t state = ROOT_STATE;
+            for (char c : phrase.first)
+            {
+                uint64_t key = ((uint64_t) state << 8) | foldByte((unsigned char) c);
+                auto result = edges.try_emplace(key, (int32_t) terminal.size());
+                if (result.second)
+                {
+                    edgeCount[state]++;
+                    edgeCount.push_back(0);
+                    terminal.push_back(0);
+                }
+                state = result.first->second;
+            }
+            terminal[state] += phrase.second;
+            phraseState.push_back(state);
+        }
+        _states = (int) terminal.size();
+
+        std::vector<int32_t>& outputStart = _tables.outputStart;
+        outputStart.assign(_states + 1, 0);
+        for (int32_t state : phraseState)
+        {
+            outputStart[state + 1] += (state != ROOT_STATE);
+        }
+        for (int s = 0; s < _states; s++)
+        {
+            outputStart[s + 1] += outputStart[s];
+        }
+        _tables.outputPhrase.assign(outputStart[_states], 0);
+        std::vector<int32_t> nextOutput(outputStart.begin(), outputStart.end() - 1);
+        for (size_t i = 0; i < phraseState.size(); i++)
+        {
+            if (phraseState[i] != ROOT_STATE)
+            {
+                _tables.outputPhrase[nextOutput[phraseState[i]]++] = (int32_t) i;
+            }
+        }
+
+        std::vector<int32_t>& edgeStart = _tables.edgeStart;
+        std::vector<unsigned char>& edgeLabel = _tables.edgeLabel;
+        std::vector<int32_t>& edgeTarget = _tables.edgeTarget;
+        edgeStart.assign(_states + 1, 0);
+        for (int s = 0; s < _states; s++)
+        {
+            edgeStart[s + 1] = edgeStart[s] + edgeCount[s];
+        }
+        edgeLabel.assign(edges.size(), 0);
+        edgeTarget.assign(edges.size(), NO_EDGE);
+        std::vector<int32_t> filled(edgeStart.begin(), edgeStart.end() - 1);
+        for (const auto& edge : edges)
+        {
+            int32_t at = filled[edge.first >> 8]++;
+            edgeLabel[at] = (unsigned char) (edge.first & 0xFF);
+            edgeTarget[at] = edge.second;
+        }
+        for (int s = 0; s < _states; s++)
+        {
+            // Sort the few edges of the state by their byte (insertion sort).
+            for (int32_t i = edgeStart[s] + 1; i < edgeStart[s + 1]; i++)
+            {
+                for (int32_t j = i; j > edgeStart[s] && edgeLabel[j - 1] > edgeLabel[j]; j--)
+                {
+                    std::swap(edgeLabel[j - 1], edgeLabel[j]);
+                    std::swap(edgeTarget[j - 1], edgeTarget[j]);
+                }
+            }
+        }
+        _tables.rootNext.assign(ALPHABET_SIZE, NO_EDGE);
+        for (int32_t i = edgeStart[ROOT_STATE]; i < edgeStart[ROOT_STATE + 1]; i++)
+        {
+            _tables.rootNext[edgeLabel[i]] = edgeTarget[i];
+        }
+    }
+
+    /**
+     * Compute the failure link, the output link and the total score of every state, in
+     * breadth-first order so the failure link of a state is always done before the state.
+     * @param terminal The total score of the phrases that end in every state.
+     * @return The states in breadth-first order.
+     */
+    std::vector<int32_t> _buildFailures(const std::vector<int64_t>& terminal)
+    {
+        _tables.fail.assign(_states, ROOT_STATE);
+        _tables.score.assign(_states, 0);
+        _tables.outputLink.assign(_states, ROOT_STATE);
+        _bindTables();
+        std::vector<int32_t> order;
+        order.reserve(_states);
+        order.push_back(ROOT_STATE);
+        for (size_t head = 0; head < order.size(); head++)
+        {
+            int32_t state = order[head];
+            _tables.score[state] = terminal[state] +
+                                   (state == ROOT_STATE ? 0 : _score[_fail[state]]);
+            _maxStateScore = std::max(_maxStateScore, _score[state]);
+            int32_t fail = _fail[state];
+            if (state != ROOT_STATE)
+            {
+                _tables.outputLink[state] = _outputStart[fail] != _outputStart[fail + 1] ?
+                                            fail : _outputLink[fail];
+            }
+            for (int32_t i = _edgeStart[state]; i < _edgeStart[state + 1]; i++)
+            {
+                int32_t child = _edgeTarget[i];
+                if (state != ROOT_STATE)
+                {
+                    _tables.fail[child] = _next(_fail[state], _edgeLabel[i]);
+                }
+                order.push_back(child);
+            }
+        }
+        return order;
+    }
+
+    /**
+     * Compile the dense transition table, if it has no more than the given number of cells.
+     * @param order The states in breadth-first order.
+     * @param denseLimit The maximal number of cells in the table.
+     */
+    void _buildDense(const std::vector<int32_t>& order, int64_t denseLimit)
+    {
+        std::vector<unsigned char>& byteClass = _tables.byteClass;
+        byteClass.assign(ALPHABET_SIZE, 0);
+        _classes = 1;
+        for (unsigned char label : _edgeLabel)
+        {
+            if (byteClass[label] == 0)
+            {
+                byteClass[label] = (unsigned char) _classes++;
+            }
+        }
+        if ((int64_t) _states * _classes > denseLimit)
+        {
+            _classes = 0;
+            byteClass.clear();
+            return;
+        }
+        _tables.dense.assign((size_t) _states * _classes, ROOT_STATE);
+        for (int32_t state : order)
+        {
+            int32_t *row = &_tables.dense[(size_t) state * _classes];
+            if (state != ROOT_STATE)
+            {
+                const int32_t *failRow = &_tables.dense[(size_t) _fail[state] * _classes];
+                std::copy(failRow, failRow + _classes, row);
+            }
+            for (int32_t i = _edgeStart[state]; i < _edgeStart[state + 1]; i++)
+            {
+                row[byteClass[_edgeLabel[i]]] = _edgeTarget[i];
+            }
+        }
+    }
+
+    /**
+     * @param size A size in bytes.
+     * @return The size rounded up to the alignment of the sections.
+     */
+    static size_t _aligned(size_t size)
+    {
+        return (size + IMAGE_ALIGN - 1) / IMAGE_ALIGN * IMAGE_ALIGN;
+    }
+
+    /**
+     * @param data The sections of a compiled spam database, a multiple of IMAGE_ALIGN bytes.
+     * @param size The number of bytes.
+     * @return The checksum of the sections.
+     */
+    static uint64_t _checksum(const char *data, size_t size)
+    {
+        uint64_t sum = size;
+        for (size_t i = 0; i < size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            sum = (sum ^ word) * HASH_MIX;
+            sum ^= sum >> 29;
+        }
+        return sum;
+    }
+
+    /**
+     * Point a view to a section of the mapped compiled spam database, if the section is valid.
+     * @param header The header of the database.
+     * @param section The section.
+     * @param count The expected number of elements of the section.
+     * @param view Set to the section.
+     * @return True if the section has the expected size and is inside the file, false otherwise.
+     */
+    template <typename T>
+    bool _bindSection(const ImageHeader& header, Section section, uint64_t count,
+                      ArrayView<T>& view) const
+    {
+        uint64_t offset = header.sections[section][0];
+        if (header.sections[section][1] != count || offset % IMAGE_ALIGN != 0 ||
+            offset > _image.size() || count > (_image.size() - offset) / sizeof(T))
+        {
+            return false;
+        }
+        view = ArrayView<T>((const T *) (_image.view().data() + offset), count);
+        return true;
+    }
+
+    /**
+     * Point all the views to the sections of the mapped compiled spam database.
+     * @return True if the database is valid, false otherwise.
+     */
+    bool _bindImage()
+    {
+        std::string_view image = _image.view();
+        if (!isImage(image) || image.size() < sizeof(ImageHeader))
+        {
+            return false;
+        }
+        ImageHeader header;
+        std::memcpy(&header, image.data(), sizeof(header));
+        if (header.version != IMAGE_VERSION || header.byteOrder != IMAGE_BYTE_ORDER ||
+            header.fileSize != image.size() || header.states <= 0 || header.classes < 0 ||
+            (image.size() - sizeof(header)) % IMAGE_ALIGN != 0 ||
+            header.checksum != _checksum(image.data() + sizeof(header),
+                                         image.size() - sizeof(header)))
+        {
+            return false;
+        }
+        _states = header.states;
+        _emptyScore = header.emptyScore;
+        _maxStateScore = header.maxStateScore;
+        _nonNegative = (header.flags & IMAGE_NON_NEGATIVE) != 0;
+        _classes = header.classes;
+        uint64_t states = (uint64_t) _states;
+        uint64_t phrases = header.sections[PHRASE_SCORE][1];
+        if (!_bindSection(header, EDGE_START, states + 1, _edgeStart) ||
+            !_bindSection(header, EDGE_LABEL, header.sections[EDGE_LABEL][1], _edgeLabel) ||
+            !_bindSection(header, EDGE_TARGET, _edgeLabel.size(), _edgeTarget) ||
+            !_bindSection(header, FAIL, states, _fail) ||
+            !_bindSection(header, SCORE, states, _score) ||
+            !_bindSection(header, ROOT_NEXT, ALPHABET_SIZE, _rootNext) ||
+            !_bindSection(header, BYTE_CLASS, _classes == 0 ? 0 : ALPHABET_SIZE, _byteClass) ||
+            !_bindSection(header, DENSE, states * _classes, _dense) ||
+            !_bindSection(header, PHRASE_SCORE, phrases, _phraseScore) ||
+            !_bindSection(header, PHRASE_START, phrases + 1, _phraseStart) ||
+            !_bindSection(header, PHRASE_TEXT, header.sections[PHRASE_TEXT][1], _phraseText) ||
+            !_bindSection(header, OUTPUT_START, states + 1, _outputStart) ||
+            !_bindSection(header, OUTPUT_PHRASE, header.sections[OUTPUT_PHRASE][1],
+                          _outputPhrase) ||
+            !_bindSection(header, OUTPUT_LINK, states, _outputLink))
+        {
+            return false;
+        }
+        return _validStarts(_edgeStart, _edgeLabel.size()) &&
+               _validStarts(_phraseStart, _phraseText.size()) &&
+               _validStarts(_outputStart, _outputPhrase.size()) && _validIndices(phrases);
+    }
+
+    /**
+     * @param starts The starts of the ranges of a section, and the end of the last one.
+     * @param size The number of elements of the section.
+     * @return True if the ranges start at 0, never go back and end at the end of the section,
+     * false otherwise.
+     */
+    template <typename T>
+    static bool _validStarts(const ArrayView<T>& starts, uint64_t size)
+    {
+        if (starts[0] != 0 || (uint64_t) starts[starts.size() - 1] != size)
+        {
+            return false;
+        }
+        for (size_t i = 1; i < starts.size(); i++)
+        {
+            if (starts[i] < starts[i - 1])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Check every index in the sections of a mapped compiled spam database, once, so a scan of a
+     * corrupt database can't read outside of it or follow links forever: the trie edges must make
+     * a tree of all the states (where, like _buildTrie numbers them, every state comes after its
+     * parent), the failure and output links must lead to shallower states, and every other state,
+     * byte class and phrase index must be in its range.
+     * @param phrases The number of phrases.
+     * @return True if all the indices are valid, false otherwise.
+     */
+    bool _validIndices(uint64_t phrases) const
+    {
+        std::vector<int32_t> depth(_states, NO_EDGE);
+        depth[ROOT_STATE] = 0;
+        for (int32_t s = ROOT_STATE; s < _states; s++)
+        {
+            if (depth[s] == NO_EDGE)
+            {
+                return false;
+            }
+            for (int32_t i = _edgeStart[s]; i < _edgeStart[s + 1]; i++)
+            {
+                int32_t target = _edgeTarget[i];
+                if (target <= s || target >= _states || depth[target] != NO_EDGE)
+                {
+                    return false;
+                }
+                depth[target] = depth[s] + 1;
+            }
+        }
+        if (_fail[ROOT_STATE] != ROOT_STATE)
+        {
+            return false;
+        }
+        for (int32_t s = ROOT_STATE + 1; s < _states; s++)
+        {
+            if (_fail[s] < ROOT_STATE || _fail[s] >= _states || depth[_fail[s]] >= depth[s] ||
+                _outputLink[s] < ROOT_STATE || _outputLink[s] >= _states ||
+                depth[_outputLink[s]] >= depth[s])
+            {
+                return false;
+            }
+        }
+        for (size_t c = 0; c < _rootNext.size(); c++)
+        {
+            if (_rootNext[c] != NO_EDGE && (_rootNext[c] <= ROOT_STATE || _rootNext[c] >= _states))
+            {
+                return false;
+            }
+        }
+        for (size_t c = 0; c < _byteClass.size(); c++)
+        {
+            if (_byteClass[c] >= _classes)
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < _dense.size(); i++)
+        {
+            if (_dense[i] < ROOT_STATE || _dense[i] >= _states)
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < _outputPhrase.size(); i++)
+        {
+            if (_outputPhrase[i] < 0 || (uint64_t) _outputPhrase[i] >= phrases)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Constructor of an automaton that is used from a mapped compiled spam database. If the
+     * database is invalid, it will throw an exception.
+     * @param image The compiled spam database.
+     */
+    explicit AhoCorasick(MappedFile&& image) :
+        _states(0),
+        _emptyScore(0),
+        _maxStateScore(0),
+        _nonNegative(true),
+        _classes(0),
+        _image(std::move(image)),
+        _prefilter(false),
+        _pairFilter(false)
+    {
+        _image.advise(MADV_RANDOM);
+        if (!_bindImage())
+        {
+            throw std::invalid_argument(INVALID_IMAGE);
+        }
+        _bindPrefilter();
+    }
+
+public:
+
+    /**
+     * Build the automaton of the phrases of the given map. The phrases are matched in lower case.
+     * @param phrases Map of phrases and their scores, like HashMap<std::string, int>.
+     * @param denseLimit The maximal number of cells of the dense transition table, 0 to always
+     * use the trie edges (default=DEF_DENSE_LIMIT).
+     */
+    template <typename Map>
+    explicit AhoCorasick(const Map& phrases, int64_t denseLimit = DEF_DENSE_LIMIT) :
+        _states(0),
+        _emptyScore(0),
+        _maxStateScore(0),
+        _nonNegative(true),
+        _classes(0),
+        _prefilter(false),
+        _pairFilter(false)
+    {
+        std::vector<int64_t> terminal;
+        _buildTrie(phrases, terminal);
+        std::vector<int32_t> order = _buildFailures(terminal);
+        _buildDense(order, denseLimit);
+        _bindTables();
+        _bindPrefilter();
+    }
+
+    AhoCorasick(const AhoCorasick&) = delete;
+
+    AhoCorasick& operator=(const AhoCorasick&) = delete;
+
+    AhoCorasick(AhoCorasick&&) = default;
+
+    AhoCorasick& operator=(AhoCorasick&&) = default;
+
+    /**
+     * @param contents The contents of a file.
+     * @return True if the file starts like a compiled spam database, false otherwise.
+     */
+    static bool isImage(std::string_view contents)
+    {
+        return contents.size() >= sizeof(IMAGE_MAGIC) &&
+               std::memcmp(contents.data(), IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) == 0;
+    }
+
+    /**
+     * Use the automaton of a compiled spam database in place. Its checksum and its indices are
+     * checked first, which takes time linear in its size. If the database is invalid, it will
+     * throw an exception.
+     * @param image The mapped compiled spam database, that the automaton keeps.
+     * @return The automaton.
+     */
+    static AhoCorasick open(MappedFile&& image)
+    {
+        return AhoCorasick(std::move(image));
+    }
+
+    /**
+     * Write the automaton as a compiled spam database.
+     * @param out The stream to write to.
+     * @return True if the database was written, false otherwise.
+     */
+    bool save(std::ostream& out) const
+    {
+        const std::pair<const char *, size_t> sections[SECTIONS] = {
+            {(const char *) _edgeStart.data(), sizeof(int32_t)},
+            {(const char *) _edgeLabel.data(), sizeof(unsigned char)},
+            {(const char *) _edgeTarget.data(), sizeof(int32_t)},
+            {(const char *) _fail.data(), sizeof(int32_t)},
+            {(const char *) _score.data(), sizeof(int64_t)},
+            {(const char *) _rootNext.data(), sizeof(int32_t)},
+            {(const char *) _byteClass.data(), sizeof(unsigned char)},
+            {(const char *) _dense.data(), sizeof(int32_t)},
+            {(const char *) _phraseScore.data(), sizeof(int64_t)},
+            {(const char *) _phraseStart.data(), sizeof(uint64_t)},
+            {(const char *) _phraseText.data(), sizeof(char)},
+            {(const char *) _outputStart.data(), sizeof(int32_t)},
+            {(const char *) _outputPhrase.data(), sizeof(int32_t)},
+            {(const char *) _outputLink.data(), sizeof(int32_t)}};
+        const size_t counts[SECTIONS] = {
+            _edgeStart.size(), _edgeLabel.size(), _edgeTarget.size(), _fail.size(), _score.size(),
+            _rootNext.size(), _byteClass.size(), _dense.size(), _phraseScore.size(),
+            _phraseStart.size(), _phraseText.size(), _outputStart.size(), _outputPhrase.size(),
+            _outputLink.size()};
+
+        ImageHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+        header.version = IMAGE_VERSION;
+        header.byteOrder = IMAGE_BYTE_ORDER;
+        header.emptyScore = _emptyScore;
+        header.maxStateScore = _maxStateScore;
+        header.flags = _nonNegative ? IMAGE_NON_NEGATIVE : 0;
+        header.states = _states;
+        header.classes = _classes;
+        std::vector<char> payload;
+        for (int i = 0; i < SECTIONS; i++)
+        {
+            size_t bytes = counts[i] * sections[i].second;
+            header.sections[i][0] = sizeof(header) + payload.size();
+            header.sections[i][1] = counts[i];
+            payload.insert(payload.end(), sections[i].first, sections[i].first + bytes);
+            payload.resize(_aligned(payload.size()), 0);
+        }
+        header.fileSize = sizeof(header) + payload.size();
+        header.checksum = _checksum(payload.data(), payload.size());
+        out.write((const char *) &header, sizeof(header));
+        out.write(payload.data(), (std::streamsize) payload.size());
+        return (bool) out;
+    }
+
+    /**
+     * @return The number of states of the automaton.
+     */
+    int states() const
+    {
+        return _states;
+    }
+
+    /**
+     * @return True if the automaton uses the dense transition table, false otherwise.
+     */
+    bool dense() const
+    {
+        return !_dense.empty();
+    }
+
+    /**
+     * @return The number of phrases of the automaton.
+     */
+    size_t phrases() const
+    {
+        return _phraseScore.size();
+    }
+
+    /**
+     * @param index The index of a phrase.
+     * @return The phrase, as it is in the spam file.
+     */
+    std::string_view phrase(size_t index) const
+    {
+        return std::string_view(_phraseText.data() + _phraseStart[index],
+                                _phraseStart[index + 1] - _phraseStart[index]);
+    }
+
+    /**
+     * @param index The index of a phrase.
+     * @return The score of the phrase.
+     */
+    int64_t phraseScore(size_t index) const
+    {
+        return _phraseScore[index];
+    }
+
+    /**
+     * @return The highest score a single byte of a text can add, the score of the best state.
+     */
+    int64_t maxStateScore() const
+    {
+        return _maxStateScore;
+    }
+
+    /**
+     * @return True if no phrase has a negative score, so the score of a text never goes down while
+     * it's scanned, false otherwise.
+     */
+    bool nonNegative() const
+    {
+        return _nonNegative;
+    }
+
+    /**
+     * @return The total score of the empty phrases, that occur once at every position of a text
+     * and once after its end.
+     */
+    int64_t emptyScore() const
+    {
+        return _emptyScore;
+    }
+
+    /**
+     * Continue a scan of a text with its next part. The text must already be in lower case.
+     * @param text The next part of the text.
+     * @param length The length of the part.
+     * @param state The state of the scan, ROOT_STATE at the start of the text. Updated to the
+     * state after this part.
+     * @return The score of the phrases that end in this part (without empty phrases).
+     */
+    int64_t scan(const char *text, size_t length, int32_t& state) const
+    {
+        size_t skipped = 0;
+        return scan(text, length, state, skipped);
+    }
+
+    /**
+     * Continue a scan of a text with its next part like scan, and count the bytes of the part that
+     * the scan jumped over, because no phrase could start at them.
+     * @param text The next part of the text, in lower case.
+     * @param length The length of the part.
+     * @param state The state of the scan, ROOT_STATE at the start of the text. Updated to the
+     * state after this part.
+     * @param skipped Increased by the number of bytes the scan jumped over.
+     * @return The score of the phrases that end in this part (without empty phrases).
+     */
+    int64_t scan(const char *text, size_t length, int32_t& state, size_t& skipped) const
+    {
+        return _scan(text, length, state, [](int32_t, size_t) {}, skipped);
+    }
+
+    /**
+     * Continue a scan of a text with its next part like scan, and also report every occurrence of
+     * every (non-empty) phrase that ends in this part.
+     * @param text The next part of the text, in lower case.
+     * @param length The length of the part.
+     * @param state The state of the scan, ROOT_STATE at the start of the text. Updated to the
+     * state after this part.
+     * @param skipped Increased by the number of bytes the scan jumped over.
+     * @param match A function that gets the index of a phrase and the index in this part of the
+     * byte after the end of its occurrence.
+     * @return The score of the phrases that end in this part (without empty phrases).
+     */
+    template <typename Match>
+    int64_t scanMatches(const char *text, size_t length, int32_t& state, size_t& skipped,
+                        Match match) const
+    {
+        return _scan(text, length, state, [this, &match](int32_t cur, size_t end)
+        {
+            for (int32_t s = cur; s != ROOT_STATE; s = _outputLink[s])
+            {
+                for (int32_t i = _outputStart[s]; i < _outputStart[s + 1]; i++)
+                {
+                    match((size_t) _outputPhrase[i], end);
+                }
+            }
+        }, skipped);
+    }
+
+    /**
+     * @param text A whole text, in lower case.
+     * @return The total score of all the occurrences of all the phrases in the text.
+     */
+    int64_t score(std::string_view text) const
+    {
+        int32_t state = ROOT_STATE;
+        return scan(text.data(), text.size(), state) + _emptyScore * ((int64_t) text.size() + 1);
+    }
+
+};
+
+#endif //EX3_AHOCORASICK_HPP
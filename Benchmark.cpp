@@ -0,0 +1,608 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <malloc.h>
+#include "HashMap.hpp"
+#include "ConcurrentHashMap.hpp"
+#include "AhoCorasick.hpp"
+#include "MessageScorer.hpp"
+
+/**
+ * Defines the program usage massage.
+ */
+const char* USAGE_MSG = "Usage: Benchmark [maximal map size]";
+/**
+ * Defines the smallest map size of the map benchmarks.
+ */
+const int MIN_SIZE = 1000;
+/**
+ * Defines the default largest map size of the map benchmarks.
+ */
+const int DEF_MAX_SIZE = 10000000;
+/**
+ * Defines the factor between two following map sizes.
+ */
+const int SIZE_FACTOR = 10;
+/**
+ * Defines the minimal number of operations that every timed loop runs, so small maps are timed
+ * over many rounds.
+ */
+const int64_t MIN_OPERATIONS = 2000000;
+/**
+ * Defines the seed of every random generator, so every run uses the same keys and corpus.
+ */
+const uint64_t SEED = 20200101;
+/**
+ * Defines the odd multiplier that turns an index into a unique, scattered int key.
+ */
+const uint32_t INT_KEY_MULTIPLIER = 0x9E3779B1u;
+/**
+ * Defines the letters of the generated keys and words.
+ */
+const char* LETTERS = "abcdefghijklmnopqrstuvwxyz";
+/**
+ * Defines the first byte of a key that is never inserted, so it is missed by every lookup.
+ */
+const char MISS_PREFIX = '#';
+/**
+ * Defines the phrase counts of the scoring benchmarks.
+ */
+const int PHRASE_COUNTS[] = {100, 10000, 100000};
+/**
+ * Defines the massage sizes (in bytes) of the scoring benchmarks.
+ */
+const size_t MASSAGE_SIZES[] = {1 << 10, 64 << 10, 1 << 20};
+/**
+ * Defines the number of words of the vocabulary of the generated corpus.
+ */
+const int VOCABULARY_SIZE = 50000;
+/**
+ * Defines the maximal number of words of a generated phrase.
+ */
+const int MAX_PHRASE_WORDS = 3;
+/**
+ * Defines the number of words of a line of a generated massage.
+ */
+const int LINE_WORDS = 12;
+/**
+ * Defines the largest map size of the concurrent map benchmarks.
+ */
+const int CONCURRENT_SIZE = 1000000;
+/**
+ * Defines the number of operations of the mixed concurrent benchmark for every insert_or_assign,
+ * the rest of them are lookups.
+ */
+const int MIXED_WRITE_PERIOD = 10;
+/**
+ * Defines the massage of a concurrent map that lost or changed a pair.
+ */
+const char* CONCURRENT_FAILED_MSG = "ConcurrentHashMap lost a pair";
+/**
+ * Defines the status file of the process, that has its peak RSS.
+ */
+const char* STATUS_FILE = "/proc/self/status";
+/**
+ * Defines the file that resets the peak RSS of the process.
+ */
+const char* CLEAR_REFS_FILE = "/proc/self/clear_refs";
+/**
+ * Defines the value that resets the peak RSS, when it's written to CLEAR_REFS_FILE.
+ */
+const char* RESET_PEAK_RSS = "5";
+/**
+ * Defines the field of the peak RSS in STATUS_FILE.
+ */
+const std::string PEAK_RSS_FIELD = "VmHWM:";
+
+/**
+ * A sink of the results of the timed loops, so the compiler can't drop them.
+ */
+volatile int64_t sink = 0;
+
+/**
+ * Reset the peak RSS of the process to its current RSS, so the peak of the next benchmark isn't
+ * hidden by the peak of a former one. Older kernels ignore it, and then the peak only grows.
+ */
+void resetPeakRss()
+{
+    std::ofstream clearRefs(CLEAR_REFS_FILE);
+    clearRefs << RESET_PEAK_RSS;
+}
+
+/**
+ * @return The peak RSS of the process in KB, or 0 if it's unknown.
+ */
+int64_t peakRssKb()
+{
+    std::ifstream status(STATUS_FILE);
+    std::string field;
+    while (status >> field)
+    {
+        if (field == PEAK_RSS_FIELD)
+        {
+            int64_t value = 0;
+            status >> value;
+            return value;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @return The number of bytes that are allocated on the heap.
+ */
+int64_t heapBytes()
+{
+    struct mallinfo2 info = mallinfo2();
+    return (int64_t) (info.uordblks + info.hblkhd);
+}
+
+/**
+ * @return The current time in nanoseconds.
+ */
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Print one result as a JSON object.
+ * @param first True if it's the first result, false otherwise.
+ * @param fields The fields of the object, already written as JSON.
+ * @param op The name of the timed operation.
+ * @param nsPerOp The time of one operation in nanoseconds.
+ */
+void printResult(bool& first, const std::string& fields, const std::string& op, double nsPerOp)
+{
+    std::cout << (first ? "\n" : ",\n") << "    {" << fields << ", \"op\": \"" << op
+              << "\", \"ns_per_op\": " << nsPerOp << ", \"peak_rss_kb\": " << peakRssKb() << "}";
+    first = false;
+}
+
+/**
+ * @param random The random generator.
+ * @param length The length of the word.
+ * @return A word of random lower case letters.
+ */
+std::string randomWord(std::mt19937_64& random, int length)
+{
+    std::string word(length, ' ');
+    for (char& c : word)
+    {
+        c = LETTERS[random() % 26];
+    }
+    return word;
+}
+
+/**
+ * Make unique string keys, whose lengths are like the ones of words, phrases and URLs: most of
+ * them are 4 to 12 bytes long, a quarter are 13 to 32 bytes long and a few are up to 96 bytes long.
+ * @param count The number of keys.
+ * @param prefix The first byte of every key.
+ * @return The keys.
+ */
+std::vector<std::string> makeStringKeys(int count, char prefix)
+{
+    std::mt19937_64 random(SEED + (uint64_t) prefix);
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        int kind = (int) (random() % 20);
+        int length = kind < 14 ? 4 + (int) (random() % 9) :
+                     kind < 19 ? 13 + (int) (random() % 20) : 33 + (int) (random() % 64);
+        // The index at the end makes every key unique.
+        std::string key = prefix + randomWord(random, length) + std::to_string(i);
+        keys.push_back(std::move(key));
+    }
+    return keys;
+}
+
+/**
+ * Make unique int keys that are scattered over all the ints.
+ * @param count The number of keys.
+ * @param first The index of the first key: the keys of disjoint index ranges are disjoint.
+ * @return The keys.
+ */
+std::vector<int> makeIntKeys(int count, int first)
+{
+    std::vector<int> keys;
+    keys.reserve(count);
+    for (int i = first; i < first + count; i++)
+    {
+        keys.push_back((int) ((uint32_t) i * INT_KEY_MULTIPLIER));
+    }
+    return keys;
+}
+
+/**
+ * @param map The map.
+ * @param key The key.
+ * @return True if the key is in the map, false otherwise.
+ */
+template <typename Map, typename KeyT>
+bool contains(const Map& map, const KeyT& key)
+{
+    return map.find(key) != map.end();
+}
+
+/**
+ * Run the insert, hit, miss, iteration and churn benchmarks of a map type with the given keys.
+ * @param first True if no result was printed yet, false otherwise.
+ * @param fields The fields that describe the map type, the key type and the size.
+ * @param keys The keys to insert.
+ * @param missing Keys that aren't inserted, as many as the inserted keys.
+ */
+template <typename Map, typename KeyT>
+void benchmarkMap(bool& first, const std::string& fields, const std::vector<KeyT>& keys,
+                  const std::vector<KeyT>& missing)
+{
+    int count = (int) keys.size();
+    int64_t rounds = std::max((int64_t) 1, MIN_OPERATIONS / count);
+    std::vector<int> order(count);
+    for (int i = 0; i < count; i++)
+    {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(SEED));
+    resetPeakRss();
+
+    int64_t heap = heapBytes();
+    int64_t start = nowNs();
+    Map map;
+    for (int i = 0; i < count; i++)
+    {
+        map[keys[i]] = i;
+    }
+    double insertNs = (double) (nowNs() - start) / count;
+    double bytes = (double) (heapBytes() - heap) / count;
+    printResult(first, fields + ", \"bytes_per_entry\": " + std::to_string(bytes), "insert",
+                insertNs);
+
+    int64_t found = 0;
+    start = nowNs();
+    for (int64_t round = 0; round < rounds; round++)
+    {
+        for (int i : order)
+        {
+            found += contains(map, keys[i]);
+        }
+    }
+    printResult(first, fields, "hit", (double) (nowNs() - start) / ((double) rounds * count));
+
+    start = nowNs();
+    for (int64_t round = 0; round < rounds; round++)
+    {
+        for (int i : order)
+        {
+            found += contains(map, missing[i]);
+        }
+    }
+    printResult(first, fields, "miss", (double) (nowNs() - start) / ((double) rounds * count));
+
+    int64_t total = 0;
+    start = nowNs();
+    for (int64_t round = 0; round < rounds; round++)
+    {
+        for (const auto& pair : map)
+        {
+            total += pair.second;
+        }
+    }
+    printResult(first, fields, "iterate", (double) (nowNs() - start) / ((double) rounds * count));
+
+    // Every step erases a random present key and inserts a key that was missing, so the map
+    // keeps its size while its pairs are replaced.
+    std::vector<KeyT> present(keys);
+    std::mt19937_64 random(SEED);
+    start = nowNs();
+    for (int i = 0; i < count; i++)
+    {
+        size_t victim = random() % present.size();
+        map.erase(present[victim]);
+        map[missing[i]] = i;
+        present[victim] = missing[i];
+    }
+    printResult(first, fields, "churn", (double) (nowNs() - start) / count);
+    sink = sink + found + total + (int64_t) map.size();
+}
+
+/**
+ * Run the map benchmarks of HashMap and std::unordered_map for all the sizes.
+ * @param first True if no result was printed yet, false otherwise.
+ * @param maxSize The largest size.
+ */
+void benchmarkMaps(bool& first, int maxSize)
+{
+    for (int64_t size = MIN_SIZE; size <= maxSize; size *= SIZE_FACTOR)
+    {
+        int count = (int) size;
+        std::string sizeField = ", \"size\": " + std::to_string(count);
+        {
+            std::vector<int> keys = makeIntKeys(count, 0);
+            std::vector<int> missing = makeIntKeys(count, count);
+            benchmarkMap<HashMap<int, int>>(first, "\"map\": \"HashMap\", \"keys\": \"int\"" +
+                                            sizeField, keys, missing);
+            benchmarkMap<std::unordered_map<int, int>>(
+                first, "\"map\": \"unordered_map\", \"keys\": \"int\"" + sizeField, keys, missing);
+        }
+        {
+            std::vector<std::string> keys = makeStringKeys(count, LETTERS[0]);
+            std::vector<std::string> missing = makeStringKeys(count, MISS_PREFIX);
+            benchmarkMap<HashMap<std::string, int>>(
+                first, "\"map\": \"HashMap\", \"keys\": \"string\"" + sizeField, keys, missing);
+            benchmarkMap<std::unordered_map<std::string, int>>(
+                first, "\"map\": \"unordered_map\", \"keys\": \"string\"" + sizeField, keys,
+                missing);
+        }
+    }
+}
+
+/**
+ * Run the given function on the given number of threads at once, and wait for all of them.
+ * @param threads The number of threads.
+ * @param func A function that gets the index of its thread.
+ */
+template <typename F>
+void runThreads(int threads, F func)
+{
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back(func, t);
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+/**
+ * Run the concurrent benchmarks of ConcurrentHashMap with int keys, on 1 thread and on every
+ * power of two threads up to the number of cores: the threads insert disjoint keys at once, then
+ * look up random keys with an insert_or_assign every MIXED_WRITE_PERIOD operations, then only look
+ * up random keys, and then all look up the same key. After the inserts every pair is checked, so
+ * a lost or a wrong pair fails the benchmark.
+ * @param first True if no result was printed yet, false otherwise.
+ * @param maxSize The largest map size.
+ * @return True if the map kept all its pairs, false otherwise.
+ */
+bool benchmarkConcurrent(bool& first, int maxSize)
+{
+    int count = std::min(maxSize, CONCURRENT_SIZE);
+    std::vector<int> keys = makeIntKeys(count, 0);
+    int cores = (int) std::max(1u, std::thread::hardware_concurrency());
+    for (int threads = 1; threads <= cores; threads *= 2)
+    {
+        std::string fields = "\"bench\": \"concurrent\", \"map\": \"ConcurrentHashMap\", "
+                             "\"keys\": \"int\", \"size\": " + std::to_string(count) +
+                             ", \"threads\": " + std::to_string(threads);
+        resetPeakRss();
+        ConcurrentHashMap<int, int> map;
+        int64_t start = nowNs();
+        runThreads(threads, [&](int thread)
+        {
+            for (int i = thread; i < count; i += threads)
+            {
+                map.insert(keys[i], i);
+            }
+        });
+        printResult(first, fields, "insert", (double) (nowNs() - start) / count);
+        if (map.size() != count)
+        {
+            return false;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            if (map.at(keys[i]) != i)
+            {
+                return false;
+            }
+        }
+
+        std::vector<int64_t> found(threads, 0);
+        start = nowNs();
+        runThreads(threads, [&](int thread)
+        {
+            std::mt19937_64 random(SEED + (uint64_t) thread);
+            for (int i = 0; i < count; i++)
+            {
+                int index = (int) (random() % (uint64_t) count);
+                if (i % MIXED_WRITE_PERIOD == 0)
+                {
+                    map.insert_or_assign(keys[index], index);
+                }
+                else
+                {
+                    found[thread] += map.containsKey(keys[index]);
+                }
+            }
+        });
+        printResult(first, fields, "mixed",
+                    (double) (nowNs() - start) / ((double) threads * count));
+
+        start = nowNs();
+        runThreads(threads, [&](int thread)
+        {
+            std::mt19937_64 random(SEED + (uint64_t) thread);
+            for (int i = 0; i < count; i++)
+            {
+                found[thread] += map.containsKey(keys[(size_t) (random() % (uint64_t) count)]);
+            }
+        });
+        printResult(first, fields, "lookup",
+                    (double) (nowNs() - start) / ((double) threads * count));
+
+        // Every thread looks up the same key, so they all read the lock of one shard.
+        start = nowNs();
+        runThreads(threads, [&](int thread)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                found[thread] += map.containsKey(keys[0]);
+            }
+        });
+        printResult(first, fields, "hot_lookup",
+                    (double) (nowNs() - start) / ((double) threads * count));
+        for (int64_t hits : found)
+        {
+            sink = sink + hits;
+        }
+    }
+    return true;
+}
+
+/**
+ * A deterministic corpus of spam phrases and massages, made of the words of a vocabulary.
+ */
+class Corpus
+{
+    std::mt19937_64 _random;
+    std::vector<std::string> _vocabulary;
+
+    /**
+     * @return A word of the vocabulary: a few words are much more common than the rest, like in a
+     * real text.
+     */
+    const std::string& _word()
+    {
+        double skew = std::uniform_real_distribution<double>(0, 1)(_random);
+        return _vocabulary[(size_t) (skew * skew * skew * (double) _vocabulary.size())];
+    }
+
+public:
+
+    /**
+     * Constructor.
+     */
+    Corpus() :
+        _random(SEED)
+    {
+        _vocabulary.reserve(VOCABULARY_SIZE);
+        for (int i = 0; i < VOCABULARY_SIZE; i++)
+        {
+            _vocabulary.push_back(randomWord(_random, 2 + (int) (_random() % 9)));
+        }
+    }
+
+    /**
+     * @param count The number of phrases.
+     * @return Phrases of 1 to MAX_PHRASE_WORDS words, and a score for each of them.
+     */
+    HashMap<std::string, int> phrases(int count)
+    {
+        HashMap<std::string, int> phrases;
+        while (phrases.size() < count)
+        {
+            std::string phrase = _word();
+            int words = 1 + (int) (_random() % MAX_PHRASE_WORDS);
+            for (int i = 1; i < words; i++)
+            {
+                phrase += ' ' + _word();
+            }
+            phrases[phrase] = 1 + (int) (_random() % 10);
+        }
+        return phrases;
+    }
+
+    /**
+     * @param size The size of the massage in bytes.
+     * @return A massage of lines of LINE_WORDS words, some of them capitalized.
+     */
+    std::string massage(size_t size)
+    {
+        std::string text;
+        text.reserve(size);
+        for (int words = 1; text.size() < size; words++)
+        {
+            size_t start = text.size();
+            text += _word();
+            if (_random() % 8 == 0)
+            {
+                text[start] = (char) (text[start] - 'a' + 'A');
+            }
+            text += words % LINE_WORDS == 0 ? '\n' : ' ';
+        }
+        text.resize(size);
+        return text;
+    }
+};
+
+/**
+ * Run the scoring benchmarks: building the automaton of every phrase count, and scoring massages
+ * of every size with it, like checkSpam.
+ * @param first True if no result was printed yet, false otherwise.
+ */
+void benchmarkScoring(bool& first)
+{
+    Corpus corpus;
+    for (int phraseCount : PHRASE_COUNTS)
+    {
+        HashMap<std::string, int> phrases = corpus.phrases(phraseCount);
+        std::string fields = "\"bench\": \"scoring\", \"phrases\": " + std::to_string(phraseCount);
+        resetPeakRss();
+        int64_t heap = heapBytes();
+        int64_t start = nowNs();
+        AhoCorasick matcher(phrases);
+        double buildNs = (double) (nowNs() - start) / phraseCount;
+        double bytes = (double) (heapBytes() - heap) / phraseCount;
+        printResult(first, fields + ", \"states\": " + std::to_string(matcher.states()) +
+                    ", \"bytes_per_entry\": " + std::to_string(bytes), "build", buildNs);
+        MessageScorer scorer(matcher);
+        for (size_t size : MASSAGE_SIZES)
+        {
+            std::string massage = corpus.massage(size);
+            int64_t rounds = std::max((int64_t) 1, (int64_t) (MIN_OPERATIONS * 16 / size));
+            start = nowNs();
+            for (int64_t round = 0; round < rounds; round++)
+            {
+                scorer.reset();
+                scorer.feed(massage.data(), massage.size());
+                sink = sink + scorer.finish();
+            }
+            double massageNs = (double) (nowNs() - start) / (double) rounds;
+            printResult(first, fields + ", \"massage_bytes\": " + std::to_string(size) +
+                        ", \"ns_per_byte\": " + std::to_string(massageNs / (double) size), "score",
+                        massageNs);
+        }
+    }
+}
+
+/**
+ * Runs all the benchmarks and prints their results as one JSON object.
+ * @param argc The number of arguments.
+ * @param argv An array of the arguments.
+ * @return EXIT_SUCCESS if the benchmarks run successfully, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char *argv[])
+{
+    int maxSize = DEF_MAX_SIZE;
+    if (argc > 2 || (argc == 2 && (maxSize = std::atoi(argv[1])) < MIN_SIZE))
+    {
+        std::cerr << USAGE_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+    bool first = true;
+    std::cout << "{\n  \"seed\": " << SEED << ",\n  \"results\": [";
+    benchmarkMaps(first, maxSize);
+    bool kept = benchmarkConcurrent(first, maxSize);
+    if (kept)
+    {
+        benchmarkScoring(first);
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+    if (!kept)
+    {
+        std::cerr << CONCURRENT_FAILED_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
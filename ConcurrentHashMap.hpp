@@ -0,0 +1,244 @@
+#ifndef EX3_CONCURRENTHASHMAP_HPP
+#define EX3_CONCURRENTHASHMAP_HPP
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include "HashMap.hpp"
+
+/**
+ * Defines the default number of shards of a ConcurrentHashMap.
+ */
+const int DEF_SHARDS = 64;
+/**
+ * Defines the size of a cache line, that every shard is aligned to.
+ */
+const int CACHE_LINE = 64;
+/**
+ * Defines the first bit of the mixed hash value that picks a shard. The bits from it are above the
+ * low bits that pick the bucket of a shard's HashMap, and below the high bits of its fingerprints.
+ */
+const int SHARD_SHIFT = 32;
+/**
+ * Defines a massage for an invalid number of shards.
+ */
+const char* INVALID_SHARDS = "Invalid number of shards";
+
+/**
+ * Template class of a thread-safe HashMap.
+ * The map is split into a power of two shards, every one of them a HashMap with its own
+ * reader-writer lock, so readers of a shard don't wait for each other and writers only block the
+ * readers and writers of their own shard. Every shard resizes on its own.
+ * Reads take the shared lock too, which changes the lock's reader count, so reads of one shard by
+ * many threads at once contend on its cache line. They can't skip the lock and check a version
+ * instead, since a writer may free the tables (and the keys) that such a reader is still reading.
+ * A key's shard is picked by the middle bits of its mixed hash value, so the keys of a shard still
+ * spread over all the buckets of the shard's HashMap, which uses the low bits, and still have all
+ * the fingerprints, which are the high bits.
+ * Values are returned by copy, since a reference could be changed by another thread.
+ * @tparam KeyT The key object in the map.
+ * @tparam ValueT The value object in the map.
+ * @tparam Hash The hash function of the keys.
+ * @tparam KeyEqual The equality of the keys.
+ */
+template <typename KeyT, typename ValueT, typename Hash = DefaultHash<KeyT>,
+          typename KeyEqual = std::equal_to<>>
+class ConcurrentHashMap
+{
+    using map = HashMap<KeyT, ValueT, Hash, KeyEqual>;
+
+    /**
+     * A part of the map with its own lock.
+     */
+    struct alignas(CACHE_LINE) Shard
+    {
+        mutable std::shared_mutex lock;
+        map shardMap;
+    };
+
+    Hash _hashFunc;
+    int _shardBits;
+    std::unique_ptr<Shard[]> _shards;
+
+    /**
+     * @param key A key, a KeyT or any type the hash function of the map accepts.
+     * @return The shard of the given key.
+     */
+    template <typename K>
+    Shard& _shardOf(const K& key) const
+    {
+        if (_shardBits == 0)
+        {
+            return _shards[0];
+        }
+        uint64_t mixed = mixHash((uint64_t) _hashFunc(key));
+        return _shards[(mixed >> SHARD_SHIFT) & (uint64_t) (shards() - 1)];
+    }
+
+public:
+
+    /**
+     * Constructor. If the number of shards isn't a positive power of two, it will throw an
+     * exception.
+     * @param shards The number of shards (default=DEF_SHARDS).
+     */
+    explicit ConcurrentHashMap(int shards = DEF_SHARDS) :
+        _shardBits(0)
+    {
+        if (shards <= 0 || (shards & (shards - 1)) != 0)
+        {
+            throw std::invalid_argument(INVALID_SHARDS);
+        }
+        while ((1 << _shardBits) < shards)
+        {
+            _shardBits++;
+        }
+        _shards.reset(new Shard[shards]);
+    }
+
+    /**
+     * @return The number of shards of the map.
+     */
+    int shards() const
+    {
+        return 1 << _shardBits;
+    }
+
+    /**
+     * @return The current size of the map. Other threads may change it while it's counted.
+     */
+    int size() const
+    {
+        int total = 0;
+        for (int i = 0; i < shards(); i++)
+        {
+            std::shared_lock<std::shared_mutex> guard(_shards[i].lock);
+            total += _shards[i].shardMap.size();
+        }
+        return total;
+    }
+
+    /**
+     * @return True if the map is empty, false otherwise.
+     */
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /**
+     * If the key doesn't exist in the map, it will insert a pair of the given key and value to the
+     * map.
+     * @param key The key to insert.
+     * @param value The value to insert.
+     * @return True if the insert succeeded, false otherwise.
+     */
+    bool insert(const KeyT& key, const ValueT& value)
+    {
+        Shard& shard = _shardOf(key);
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        return shard.shardMap.insert(key, value);
+    }
+
+    /**
+     * Insert a pair of the given key and value, or assign the value to the key if it already
+     * exists in the map.
+     * @param key The key to insert.
+     * @param value The value to insert or assign.
+     * @return True if the pair was inserted, false if the value was assigned.
+     */
+    bool insert_or_assign(const KeyT& key, const ValueT& value)
+    {
+        Shard& shard = _shardOf(key);
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        return shard.shardMap.insert_or_assign(key, value).second;
+    }
+
+    /**
+     * Check if the map contains the given key.
+     * @param key the key to check, a KeyT or any type the hash function of the map accepts.
+     * @return true if the key is in the map, false otherwise.
+     */
+    template <typename K>
+    bool containsKey(const K& key) const
+    {
+        Shard& shard = _shardOf(key);
+        std::shared_lock<std::shared_mutex> guard(shard.lock);
+        return shard.shardMap.containsKey(key);
+    }
+
+    /**
+     * throw exception if the key doesn't exist in the map.
+     * @param key The key to check, a KeyT or any type the hash function of the map accepts.
+     * @return A copy of the value of the given key.
+     */
+    template <typename K>
+    ValueT at(const K& key) const
+    {
+        Shard& shard = _shardOf(key);
+        std::shared_lock<std::shared_mutex> guard(shard.lock);
+        return shard.shardMap.at(key);
+    }
+
+    /**
+     * Call the given function with the value of the given key, while no other thread can change it.
+     * @param key The key to find, a KeyT or any type the hash function of the map accepts.
+     * @param func A function that gets a const reference to the value.
+     * @return True if the key is in the map and the function was called, false otherwise.
+     */
+    template <typename K, typename F>
+    bool visit(const K& key, F func) const
+    {
+        Shard& shard = _shardOf(key);
+        std::shared_lock<std::shared_mutex> guard(shard.lock);
+        auto it = shard.shardMap.find(key);
+        if (it == shard.shardMap.end())
+        {
+            return false;
+        }
+        func(it->second);
+        return true;
+    }
+
+    /**
+     * Atomically change the value of the given key. If the key doesn't exist in the map, it is
+     * inserted first with a default value.
+     * @param key The key to change.
+     * @param func A function that gets a reference to the value and changes it.
+     */
+    template <typename F>
+    void update(const KeyT& key, F func)
+    {
+        Shard& shard = _shardOf(key);
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        func(shard.shardMap[key]);
+    }
+
+    /**
+     * If the key exist in the map, it will erase it.
+     * @param key The key to erase, a KeyT or any type the hash function of the map accepts.
+     * @return True if the erase succeeded, false otherwise.
+     */
+    template <typename K>
+    bool erase(const K& key)
+    {
+        Shard& shard = _shardOf(key);
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        return shard.shardMap.erase(key);
+    }
+
+    /**
+     * Clear the map, one shard at a time.
+     */
+    void clear()
+    {
+        for (int i = 0; i < shards(); i++)
+        {
+            std::unique_lock<std::shared_mutex> guard(_shards[i].lock);
+            _shards[i].shardMap.clear();
+        }
+    }
+
+};
+
+#endif //EX3_CONCURRENTHASHMAP_HPP
@@ -2,10 +2,26 @@
 #define EX3_HASHMAP_HPP
 
 #include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <algorithm>
+#include <iterator>
 #include <vector>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <type_traits>
 #include <stdexcept>
 #include <iostream>
+#ifdef HASHMAP_STATS
+#include <atomic>
+#include <chrono>
+#define EX3_HASHMAP_STAT(...) __VA_ARGS__
+#else
+#define EX3_HASHMAP_STAT(...)
+#endif
 
 /**
  * Defines the default capacity of a HashMap.
@@ -43,54 +59,992 @@ const char* INVALID_VECTORS = "Different size of vectors";
  * Defines a massage for key that doesn't exist in the map.
  */
 const char* INVALID_KEY = "Key doesn't exist in the map";
+/**
+ * Defines the number of low bits of a slot's metadata that hold the key's fingerprint.
+ */
+const int FINGERPRINT_BITS = 8;
+/**
+ * Defines the value that adds one probe step to a slot's metadata.
+ */
+const uint32_t DIST_INC = 1u << FINGERPRINT_BITS;
+/**
+ * Defines the mask of the fingerprint in a slot's metadata.
+ */
+const uint32_t FINGERPRINT_MASK = DIST_INC - 1;
+/**
+ * Defines the multiplier that mixes the hash codes of hash functions with weak bits.
+ */
+const uint64_t HASH_MIX = 0x9E3779B97F4A7C15ull;
+/**
+ * Defines the number of keys a batched lookup hashes and prefetches together.
+ */
+const int LOOKUP_BATCH = 16;
+
+/**
+ * Mix the given hash code, so every bit of it affects the low bits (that pick a bucket) and the
+ * high bits (that make the fingerprint) of the result. Hash functions like std::hash of integers
+ * return the key itself, and keys with equal low bits would otherwise all share a bucket.
+ * @param hash The hash code to mix.
+ * @return The mixed hash code.
+ */
+inline uint64_t mixHash(uint64_t hash)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t product = (__uint128_t) hash * HASH_MIX;
+    return (uint64_t) (product >> 64) ^ (uint64_t) product;
+#else
+    hash *= HASH_MIX;
+    return hash ^ (hash >> 32);
+#endif
+}
+
+/**
+ * Ask the processor to bring the given address into the cache, if the compiler supports it.
+ * @param address The address that will be read soon.
+ */
+inline void prefetch(const void *address)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#else
+    (void) address;
+#endif
+}
+
+#ifdef HASHMAP_STATS
+
+/**
+ * The formats of HashMapStats::dump.
+ */
+enum StatsFormat
+{
+    STATS_TEXT,
+    STATS_JSON
+};
+
+/**
+ * A counter of the statistics of a HashMap. Lookups of a const map may run in several threads at
+ * once (like in ConcurrentHashMap), so the counter is a relaxed atomic, that is copied by value.
+ */
+class StatCounter
+{
+    std::atomic<uint64_t> _value;
+
+public:
+
+    /**
+     * Constructor of a zero counter.
+     */
+    StatCounter() : _value(0) {}
+
+    /**
+     * Copy constructor.
+     * @param other The counter to copy.
+     */
+    StatCounter(const StatCounter& other) noexcept : _value(other.get()) {}
+
+    /**
+     * Copy assignment.
+     * @param other The counter to copy.
+     * @return This counter.
+     */
+    StatCounter& operator=(const StatCounter& other) noexcept
+    {
+        _value.store(other.get(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    /**
+     * @param amount The amount to add to the counter.
+     */
+    void add(uint64_t amount)
+    {
+        _value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    /**
+     * @param value A value to raise the counter to, if it's bigger.
+     */
+    void raise(uint64_t value)
+    {
+        uint64_t current = get();
+        while (current < value &&
+               !_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /**
+     * @return The value of the counter.
+     */
+    uint64_t get() const
+    {
+        return _value.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Measures one resize of a HashMap, from its construction to its destruction.
+ */
+class ResizeTimer
+{
+    StatCounter& _total;
+    StatCounter& _max;
+    std::chrono::steady_clock::time_point _start;
+
+public:
+
+    /**
+     * Constructor. Starts the time.
+     * @param total The counter of the total time of the resizes, in nanoseconds.
+     * @param max The counter of the longest resize, in nanoseconds.
+     */
+    ResizeTimer(StatCounter& total, StatCounter& max) :
+        _total(total),
+        _max(max),
+        _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ResizeTimer(const ResizeTimer&) = delete;
+
+    ResizeTimer& operator=(const ResizeTimer&) = delete;
+
+    /**
+     * Destructor. Adds the time to the counters.
+     */
+    ~ResizeTimer()
+    {
+        uint64_t ns = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - _start).count();
+        _total.add(ns);
+        _max.raise(ns);
+    }
+};
+
+/**
+ * A snapshot of the statistics of a HashMap (see HashMap::stats). A probe length is the number of
+ * slots of the index table a lookup compared, 1 for a key in the first slot of its bucket.
+ */
+struct HashMapStats
+{
+    int size = 0;
+    int capacity = 0;
+    double loadFactor = 0;
+    // The number of buckets with every number of keys: bucketHistogram[k] buckets have k keys.
+    std::vector<int64_t> bucketHistogram;
+    uint64_t hits = 0;
+    uint64_t hitProbes = 0;
+    uint64_t maxHitProbe = 0;
+    uint64_t misses = 0;
+    uint64_t missProbes = 0;
+    uint64_t maxMissProbe = 0;
+    uint64_t resizes = 0;
+    uint64_t resizeNs = 0;
+    uint64_t maxResizeNs = 0;
+    // The most slots of an old index table that one operation moved during incremental resizes.
+    uint64_t maxMigrated = 0;
+    // The bytes of the pairs, the index tables and the stored hash codes, without the memory that
+    // the keys and the values allocate themselves.
+    size_t bytes = 0;
+
+    /**
+     * @return The mean probe length of the lookups that found their key, or 0 if there were none.
+     */
+    double meanHitProbe() const
+    {
+        return hits == 0 ? 0 : (double) hitProbes / (double) hits;
+    }
+
+    /**
+     * @return The mean probe length of the lookups that didn't find their key, or 0 if there were
+     * none.
+     */
+    double meanMissProbe() const
+    {
+        return misses == 0 ? 0 : (double) missProbes / (double) misses;
+    }
+
+    /**
+     * Write the statistics to the given stream.
+     * @param out The stream.
+     * @param format Readable text lines, or one JSON object (default=STATS_TEXT).
+     */
+    void dump(std::ostream& out, StatsFormat format = STATS_TEXT) const
+    {
+        if (format == STATS_JSON)
+        {
+            out << "{\"size\": " << size << ", \"capacity\": " << capacity
+                << ", \"load_factor\": " << loadFactor << ", \"hits\": " << hits
+                << ", \"mean_hit_probe\": " << meanHitProbe() << ", \"max_hit_probe\": "
+                << maxHitProbe << ", \"misses\": " << misses << ", \"mean_miss_probe\": "
+                << meanMissProbe() << ", \"max_miss_probe\": " << maxMissProbe
+                << ", \"resizes\": " << resizes << ", \"resize_ns\": " << resizeNs
+                << ", \"max_resize_ns\": " << maxResizeNs << ", \"max_migrated\": " << maxMigrated
+                << ", \"bytes\": " << bytes
+                << ", \"bucket_histogram\": [";
+            for (size_t i = 0; i < bucketHistogram.size(); i++)
+            {
+                out << (i == 0 ? "" : ", ") << bucketHistogram[i];
+            }
+            out << "]}" << std::endl;
+            return;
+        }
+        out << "size " << size << ", capacity " << capacity << ", load factor " << loadFactor
+            << ", " << bytes << " bytes" << std::endl;
+        out << "hits " << hits << " (mean probe " << meanHitProbe() << ", max " << maxHitProbe
+            << "), misses " << misses << " (mean probe " << meanMissProbe() << ", max "
+            << maxMissProbe << ")" << std::endl;
+        out << "resizes " << resizes << " (total " << resizeNs << " ns, max " << maxResizeNs
+            << " ns, at most " << maxMigrated << " slots moved at once)" << std::endl;
+        out << "buckets by keys:";
+        for (size_t i = 0; i < bucketHistogram.size(); i++)
+        {
+            out << " " << i << ":" << bucketHistogram[i];
+        }
+        out << std::endl;
+    }
+};
+
+#endif //HASHMAP_STATS
+
+/**
+ * The hash function a HashMap uses for its keys, which is std::hash of the key type.
+ * @tparam KeyT The key object in the map.
+ */
+template <typename KeyT>
+struct DefaultHash : std::hash<KeyT> {};
+
+/**
+ * Transparent hash function of string keys. It hashes every string-like key through
+ * std::string_view, which gives the same hash code as std::hash<std::string>, so a map of strings
+ * can be searched with a std::string_view or a const char* without building a std::string.
+ * Its hash codes are already well mixed, so it is marked as avalanching.
+ */
+struct StringHash
+{
+    using is_transparent = void;
+    using is_avalanching = void;
+
+    /**
+     * @param key The string to hash.
+     * @return The hash code of the string.
+     */
+    size_t operator()(std::string_view key) const
+    {
+        return std::hash<std::string_view>()(key);
+    }
+};
+
+/**
+ * The hash function of std::string keys, with any allocator (like std::pmr::string).
+ */
+template <typename Alloc>
+struct DefaultHash<std::basic_string<char, std::char_traits<char>, Alloc>> : StringHash {};
+
+/**
+ * The hash function of std::string_view keys.
+ */
+template <>
+struct DefaultHash<std::string_view> : StringHash {};
 
 /**
  * Template class of HashMap.
+ * The pairs are kept densely in one vector, and an open-addressing index table of _capacity slots
+ * maps every bucket to them with Robin Hood linear probing. A slot keeps the distance of its pair
+ * from the pair's home bucket and a fingerprint of its hash, so a lookup reads a single flat array
+ * and almost never compares a key that doesn't match. Robin Hood probing keeps the pairs of a
+ * bucket next to each other, so a bucket is still the set of pairs whose hash code is the same.
+ * All the memory of the map, the pairs and the index table, comes from its allocator. With a
+ * std::pmr::polymorphic_allocator the pairs are constructed with uses-allocator construction, so
+ * keys like std::pmr::string take their memory from the same resource.
+ * The hash codes of a hash function that doesn't declare is_avalanching are mixed before use. With
+ * StoreHash the map keeps the hash code of every pair, so a resize never hashes a key again. Keys
+ * are compared only when the fingerprint of their hash codes in the slot is equal.
  * @tparam KeyT The key object in the map.
  * @tparam ValueT The value object in the map.
+ * @tparam Hash The hash function of the keys.
+ * @tparam KeyEqual The equality of the keys.
+ * @tparam Allocator The allocator of the map's pairs.
+ * @tparam StoreHash True to keep the hash code of every pair (default: for non-scalar keys).
+ * With HASHMAP_STATS defined, the map also counts its lookups and resizes (see stats); otherwise
+ * none of it is compiled.
  */
-template <typename KeyT, typename ValueT>
+template <typename KeyT, typename ValueT, typename Hash = DefaultHash<KeyT>,
+          typename KeyEqual = std::equal_to<>,
+          typename Allocator = std::allocator<std::pair<KeyT, ValueT>>,
+          bool StoreHash = !std::is_scalar<KeyT>::value>
 class HashMap
 {
     using pair = std::pair<KeyT, ValueT>;
-    using bucket = std::vector<pair>;
+    using hasher = Hash;
+    using pairAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<pair>;
+    using hashAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<size_t>;
+
+    /**
+     * Enables a method for keys of type K that are not KeyT, if the hash function and the equality
+     * of the map are transparent.
+     */
+    template <typename K, typename H, typename E>
+    using _ifTransparent = std::void_t<
+        typename std::enable_if<!std::is_same<typename std::decay<K>::type, KeyT>::value>::type,
+        typename H::is_transparent, typename E::is_transparent>;
+
+    /**
+     * True if the hash function declares that its hash codes are well mixed.
+     */
+    template <typename H, typename = void>
+    struct _isAvalanching : std::false_type {};
+
+    /**
+     * True if the hash function declares that its hash codes are well mixed.
+     */
+    template <typename H>
+    struct _isAvalanching<H, typename H::is_avalanching> : std::true_type {};
+
+    /**
+     * A slot in the index table. distAndFingerprint is 0 for an empty slot, otherwise its upper
+     * bits hold the distance from the home bucket plus one and its lower bits the fingerprint.
+     */
+    struct Slot
+    {
+        uint32_t distAndFingerprint;
+        uint32_t entry;
+    };
+
+    using slotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+    using table = std::vector<Slot, slotAllocator>;
+
+    hasher _hashFunc;
+    KeyEqual _keysEqual;
+    int _capacity;
+    double _lowerLoadFactor;
+    double _upperLoadFactor;
+    std::vector<pair, pairAllocator> _entries;
+    table _slots;
+    // The hash codes of the pairs in _entries, if StoreHash is true.
+    std::vector<size_t, hashAllocator> _hashes;
+    // The incremental resize state. While a resize is in progress, _oldSlots is the previous index
+    // table, and its slots from _migrateStart (an empty slot) on are moved to _slots a few at a
+    // time; the first _migrated of them are already moved. Every insert or erase moves
+    // _migrateStep of them, which is _resizeStep or more.
+    int _resizeStep = 0;
+    int _migrateStep = 0;
+    table _oldSlots;
+    int _migrateStart = 0;
+    int _migrated = 0;
+#ifdef HASHMAP_STATS
+    /**
+     * The counters of the lookups and the resizes of the map.
+     */
+    struct StatsCounters
+    {
+        StatCounter hits;
+        StatCounter hitProbes;
+        StatCounter maxHitProbe;
+        StatCounter misses;
+        StatCounter missProbes;
+        StatCounter maxMissProbe;
+        StatCounter resizes;
+        StatCounter resizeNs;
+        StatCounter maxResizeNs;
+        StatCounter maxMigrated;
+    };
+
+    mutable StatsCounters _counters;
+
+    /**
+     * Count a lookup by the probe of the index table that it made.
+     * @param hash The hash value of the searched key.
+     * @param metadata The metadata the probe stopped at.
+     * @param hit True if the key was found, false otherwise.
+     */
+    void _countLookup(size_t hash, uint32_t metadata, bool hit) const
+    {
+        uint64_t probe = (metadata - _homeMetadata(hash)) / DIST_INC + 1;
+        (hit ? _counters.hits : _counters.misses).add(1);
+        (hit ? _counters.hitProbes : _counters.missProbes).add(probe);
+        (hit ? _counters.maxHitProbe : _counters.maxMissProbe).raise(probe);
+    }
+#endif
+
+    /**
+     * Calculate the hash code of the given key.
+     * @param key The key to find the hash code.
+     * @return The hash code of the key.
+     */
+    template <typename K>
+    int _hashCode(const K& key) const
+    {
+        return _bucketOf(_hashOf(key));
+    }
+
+    /**
+     * @param key A key, a KeyT or any type the hash function of the map accepts.
+     * @return The hash value of the key, mixed if the hash function isn't avalanching.
+     */
+    template <typename K>
+    size_t _hashOf(const K& key) const
+    {
+        if (_isAvalanching<hasher>::value)
+        {
+            return _hashFunc(key);
+        }
+        return (size_t) mixHash(_hashFunc(key));
+    }
+
+    /**
+     * @param entry An index of a pair in _entries.
+     * @return The hash value of the pair's key, without hashing it if the hash codes are stored.
+     */
+    size_t _entryHash(uint32_t entry) const
+    {
+        if (StoreHash)
+        {
+            return _hashes[entry];
+        }
+        return _hashOf(_entries[entry].first);
+    }
+
+    /**
+     * @param hash A full hash value of a key.
+     * @return The bucket of this hash value in the current capacity.
+     */
+    int _bucketOf(size_t hash) const
+    {
+        return (int) (hash & (size_t) (_capacity - 1));
+    }
+
+    /**
+     * @param hash A full hash value of a key.
+     * @return The metadata of a pair with this hash that sits in its home bucket.
+     */
+    static uint32_t _homeMetadata(size_t hash)
+    {
+        return DIST_INC | (uint32_t) ((hash >> (sizeof(size_t) * 8 - FINGERPRINT_BITS)) &
+                                      FINGERPRINT_MASK);
+    }
+
+    /**
+     * @param slots An index table.
+     * @param index A slot index in this table.
+     * @return The index of the slot after it, wrapping around the table.
+     */
+    static int _nextSlot(const table& slots, int index)
+    {
+        return (index + 1) & ((int) slots.size() - 1);
+    }
+
+    /**
+     * @return True if an incremental resize is in progress, false otherwise.
+     */
+    bool _resizing() const
+    {
+        return !_oldSlots.empty();
+    }
+
+    /**
+     * Probe an index table from the given slot, for a slot with the given metadata whose entry
+     * matches.
+     * @param slots The index table to probe.
+     * @param matches A predicate on an entry index, that is true for the searched entry.
+     * @param metadata The metadata of the searched slot in the first slot to check, set to the
+     * metadata of the slot the probe stopped at.
+     * @param index The first slot to check, set to the index of the slot the probe stopped at.
+     * @return True if the entry is in the table, false otherwise.
+     */
+    template <typename Pred>
+    static bool _probeTable(const table& slots, Pred matches, uint32_t& metadata,
+                            int& index)
+    {
+        while (true)
+        {
+            const Slot& slot = slots[index];
+            if (slot.distAndFingerprint == metadata)
+            {
+                if (matches(slot.entry))
+                {
+                    return true;
+                }
+            }
+            else if (slot.distAndFingerprint < metadata)
+            {
+                return false;
+            }
+            metadata += DIST_INC;
+            index = _nextSlot(slots, index);
+        }
+    }
+
+    /**
+     * Probe the index table once for the given key. If the key isn't in the table, the probe stops
+     * at the place a new slot of this key has to be put in.
+     * @param key The key to find, a KeyT or any type the hash function of the map accepts.
+     * @param hash The hash value of the key.
+     * @param metadata Set to the metadata of the slot the probe stopped at.
+     * @param index Set to the index of the slot the probe stopped at.
+     * @return True if the key is in the table, false otherwise.
+     */
+    template <typename K>
+    bool _probe(const K& key, size_t hash, uint32_t& metadata, int& index) const
+    {
+        metadata = _homeMetadata(hash);
+        index = _bucketOf(hash);
+        return _probeTable(_slots, _keyMatcher(key), metadata, index);
+    }
+
+    /**
+     * @param key A key, a KeyT or any type the hash function of the map accepts.
+     * @return A predicate on an entry index, that is true if the entry's key equals the given key.
+     */
+    template <typename K>
+    auto _keyMatcher(const K& key) const
+    {
+        return [this, &key](uint32_t entry) { return _keysEqual(_entries[entry].first, key); };
+    }
+
+    /**
+     * Find where a probe of the old index table of an incremental resize starts. A probe whose
+     * bucket is in the part of the table that was already moved starts from the first slot that
+     * wasn't, as if it had passed the moved slots.
+     * @param hash The hash value of the searched key.
+     * @param metadata Set to the metadata of the key in the first slot to check.
+     * @param index Set to the first slot to check.
+     */
+    void _oldProbeStart(size_t hash, uint32_t& metadata, int& index) const
+    {
+        int mask = (int) _oldSlots.size() - 1;
+        metadata = _homeMetadata(hash);
+        index = (int) (hash & (size_t) mask);
+        int moved = (index - _migrateStart) & mask;
+        if (moved < _migrated)
+        {
+            metadata += (uint32_t) (_migrated - moved) * DIST_INC;
+            index = (_migrateStart + _migrated) & mask;
+        }
+    }
+
+    /**
+     * Probe the old index table of an incremental resize for the given key.
+     * @param key The key to find, a KeyT or any type the hash function of the map accepts.
+     * @param hash The hash value of the key.
+     * @param index Set to the index of the key's slot in the old table.
+     * @return True if the key is in the old table, false otherwise.
+     */
+    template <typename K>
+    bool _probeOld(const K& key, size_t hash, int& index) const
+    {
+        uint32_t metadata;
+        _oldProbeStart(hash, metadata, index);
+        return _probeTable(_oldSlots, _keyMatcher(key), metadata, index);
+    }
+
+    /**
+     * Find the entry of the given key.
+     * @param key The key to find, a KeyT or any type the hash function of the map accepts.
+     * @return The index of the key's pair in _entries, or size() if the key isn't in the map.
+     */
+    template <typename K>
+    int _findEntry(const K& key) const
+    {
+        return _findEntry(key, _hashOf(key));
+    }
+
+    /**
+     * Find the entry of the given key, whose hash value is already known.
+     * @param key The key to find, a KeyT or any type the hash function of the map accepts.
+     * @param hash The hash value of the key.
+     * @return The index of the key's pair in _entries, or size() if the key isn't in the map.
+     */
+    template <typename K>
+    int _findEntry(const K& key, size_t hash) const
+    {
+        uint32_t metadata;
+        int index;
+        int entry = size();
+        if (_probe(key, hash, metadata, index))
+        {
+            entry = (int) _slots[index].entry;
+        }
+        else if (_resizing() && _probeOld(key, hash, index))
+        {
+            entry = (int) _oldSlots[index].entry;
+        }
+        EX3_HASHMAP_STAT(_countLookup(hash, metadata, entry != size());)
+        return entry;
+    }
+
+    /**
+     * Look up the given keys in batches of LOOKUP_BATCH, prefetching the memory of every batch
+     * before its probes, and call the given function with the entry of every key in order.
+     * @param keys The keys to find, KeyT or any type the hash function of the map accepts.
+     * @param count The number of keys.
+     * @param func A function that gets the index of a key's pair in _entries, or size().
+     */
+    template <typename K, typename F>
+    void _forEachFound(const K *keys, int count, F func) const
+    {
+        size_t hashes[LOOKUP_BATCH];
+        for (int begin = 0; begin < count; begin += LOOKUP_BATCH)
+        {
+            int batch = std::min(LOOKUP_BATCH, count - begin);
+            for (int i = 0; i < batch; i++)
+            {
+                hashes[i] = _hashOf(keys[begin + i]);
+                prefetch(&_slots[_bucketOf(hashes[i])]);
+            }
+            for (int i = 0; i < batch; i++)
+            {
+                uint32_t metadata = _homeMetadata(hashes[i]);
+                int index = _bucketOf(hashes[i]);
+                while (_slots[index].distAndFingerprint > metadata)
+                {
+                    metadata += DIST_INC;
+                    index = _nextSlot(_slots, index);
+                }
+                if (_slots[index].distAndFingerprint == metadata)
+                {
+                    prefetch(&_entries[_slots[index].entry]);
+                }
+            }
+            for (int i = 0; i < batch; i++)
+            {
+                func(_findEntry(keys[begin + i], hashes[i]));
+            }
+        }
+    }
+
+    /**
+     * Put the given slot in the given index, and shift the slots after it forward until an empty
+     * slot is reached.
+     * @param slot The slot to place.
+     * @param index The index to place the slot in.
+     */
+    void _placeAndShiftUp(Slot slot, int index)
+    {
+        while (_slots[index].distAndFingerprint != 0)
+        {
+            std::swap(slot, _slots[index]);
+            slot.distAndFingerprint += DIST_INC;
+            index = _nextSlot(_slots, index);
+        }
+        _slots[index] = slot;
+    }
+
+    /**
+     * Index the given entry, that is known not to be in the index table yet.
+     * @param entry The index of the entry in _entries.
+     * @param hash The hash value of the entry's key.
+     */
+    void _indexEntry(uint32_t entry, size_t hash)
+    {
+        uint32_t metadata = _homeMetadata(hash);
+        int index = _bucketOf(hash);
+        while (metadata <= _slots[index].distAndFingerprint)
+        {
+            metadata += DIST_INC;
+            index = _nextSlot(_slots, index);
+        }
+        _placeAndShiftUp({metadata, entry}, index);
+    }
+
+    /**
+     * Find the slot that points to the given entry, without comparing any key.
+     * @param entry The index of an entry in _entries.
+     * @param hash The hash value of the entry's key.
+     * @param index Set to the index of the entry's slot.
+     * @return The index table that contains the slot.
+     */
+    table& _slotOfEntry(uint32_t entry, size_t hash, int& index)
+    {
+        auto isEntry = [entry](uint32_t other) { return other == entry; };
+        uint32_t metadata = _homeMetadata(hash);
+        index = _bucketOf(hash);
+        if (_probeTable(_slots, isEntry, metadata, index))
+        {
+            return _slots;
+        }
+        _oldProbeStart(hash, metadata, index);
+        _probeTable(_oldSlots, isEntry, metadata, index);
+        return _oldSlots;
+    }
+
+    /**
+     * Point the slot of the entry in the given index to a new index, after the entry was moved.
+     * @param from The old index of the entry.
+     * @param to The new index of the entry.
+     */
+    void _relinkEntry(uint32_t from, uint32_t to)
+    {
+        int index;
+        table& slots = _slotOfEntry(from, _entryHash(to), index);
+        slots[index].entry = to;
+    }
+
+    /**
+     * Remove the slot in the given index of the given table and the entry it points to. The slots
+     * after it are shifted back, and the last entry is moved into the place of the removed one.
+     * @param slots The index table of the slot.
+     * @param index The index of the slot to remove.
+     */
+    void _eraseSlot(table& slots, int index)
+    {
+        uint32_t removed = slots[index].entry;
+        int next = _nextSlot(slots, index);
+        while (slots[next].distAndFingerprint >= 2 * DIST_INC)
+        {
+            slots[index] = {slots[next].distAndFingerprint - DIST_INC, slots[next].entry};
+            index = next;
+            next = _nextSlot(slots, next);
+        }
+        slots[index] = {0, 0};
+
+        uint32_t last = (uint32_t) _entries.size() - 1;
+        if (removed != last)
+        {
+            _entries[removed] = std::move(_entries[last]);
+            if (StoreHash)
+            {
+                _hashes[removed] = _hashes[last];
+            }
+            _relinkEntry(last, removed);
+        }
+        _entries.pop_back();
+        if (StoreHash)
+        {
+            _hashes.pop_back();
+        }
+    }
+
+    /**
+     * Find the entry of the given key, and throw an exception if the key doesn't exist in the map.
+     * @param key The key to find, a KeyT or any type the hash function of the map accepts.
+     * @return The index of the key's pair in _entries.
+     */
+    template <typename K>
+    int _checkedEntry(const K& key) const
+    {
+        int entry = _findEntry(key);
+        if (entry == size())
+        {
+            throw std::invalid_argument(INVALID_KEY);
+        }
+        return entry;
+    }
+
+    /**
+     * If the key exist in the map, it will erase it.
+     * @param key The key to erase, a KeyT or any type the hash function of the map accepts.
+     * @return True if the erase succeeded, false otherwise.
+     */
+    template <typename K>
+    bool _erase(const K& key)
+    {
+        _migrate(_migrateStep);
+        size_t hash = _hashOf(key);
+        uint32_t metadata;
+        int index;
+        if (_probe(key, hash, metadata, index))
+        {
+            _eraseSlot(_slots, index);
+        }
+        else if (_resizing() && _probeOld(key, hash, index))
+        {
+            _eraseSlot(_oldSlots, index);
+        }
+        else
+        {
+            return false;
+        }
+        _shrinkIfNeeded();
+        return true;
+    }
+
+    /**
+     * @param count A number of pairs.
+     * @return The smallest capacity that holds this number of pairs within the upper load factor.
+     */
+    int _capacityFor(int count) const
+    {
+        int capacity = MIN_CAPACITY;
+        while ((double) count / capacity > _upperLoadFactor)
+        {
+            capacity *= RESIZE_FACTOR;
+        }
+        return capacity;
+    }
+
+    /**
+     * Shrink a map that was reserved for more pairs than it got (like a bulk constructor with
+     * repeated keys) to the capacity it would have grown to by inserting its pairs one at a time,
+     * so it equals a map that was built that way.
+     */
+    void _shrinkToGrownCapacity()
+    {
+        int grown = std::max(DEF_CAPACITY, _capacityFor(size()));
+        if (grown < _capacity)
+        {
+            _resize(grown);
+        }
+    }
+
+    /**
+     * Erase the given entry from the map. The last entry is moved into its place.
+     * @param entry The index of the entry in _entries.
+     */
+    void _eraseEntry(uint32_t entry)
+    {
+        _migrate(_migrateStep);
+        int index;
+        table& slots = _slotOfEntry(entry, _entryHash(entry), index);
+        _eraseSlot(slots, index);
+        _shrinkIfNeeded();
+    }
+
+    /**
+     * Shrink the map if its load factor dropped under the lower load factor.
+     */
+    void _shrinkIfNeeded()
+    {
+        if (getLoadFactor() < _lowerLoadFactor && _capacity > MIN_CAPACITY)
+        {
+            _resize(_capacity / RESIZE_FACTOR);
+        }
+    }
+
+    /**
+     * If the key doesn't exist in the map, construct a pair of it and a value made from the given
+     * arguments in place. The key is hashed once and the index table is probed once (twice only
+     * when the map has to grow).
+     * @param key The key to find or insert, a KeyT or a type KeyT can be made from.
+     * @param args The arguments to construct the value from.
+     * @return The index of the key's pair in _entries, and true if it was inserted.
+     */
+    template <typename K, typename... Args>
+    std::pair<int, bool> _tryEmplace(K&& key, Args&&... args)
+    {
+        _migrate(_migrateStep);
+        size_t hash = _hashOf(key);
+        uint32_t metadata;
+        int index;
+        if (_probe(key, hash, metadata, index))
+        {
+            return std::make_pair((int) _slots[index].entry, false);
+        }
+        int oldIndex;
+        if (_resizing() && _probeOld(key, hash, oldIndex))
+        {
+            return std::make_pair((int) _oldSlots[oldIndex].entry, false);
+        }
+        bool grow = ((double) size() + 1) / _capacity > _upperLoadFactor;
+        if (grow)
+        {
+            _resize(_capacity * RESIZE_FACTOR);
+        }
+        _entries.emplace_back(std::piecewise_construct,
+                              std::forward_as_tuple(std::forward<K>(key)),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+        uint32_t entry = (uint32_t) _entries.size() - 1;
+        if (StoreHash)
+        {
+            try
+            {
+                _hashes.push_back(hash);
+            }
+            catch (...)
+            {
+                _entries.pop_back();
+                throw;
+            }
+        }
+        if (grow)
+        {
+            _indexEntry(entry, hash);
+        }
+        else
+        {
+            _placeAndShiftUp({metadata, entry}, index);
+        }
+        return std::make_pair((int) entry, true);
+    }
 
-    std::hash<KeyT> _hashFunc;
-    int _capacity;
-    int _curSize;
-    double _lowerLoadFactor;
-    double _upperLoadFactor;
-    bucket *_map;
+    /**
+     * Move up to the given number of slots of the old index table to the new one, and finish the
+     * incremental resize if no slot is left.
+     * @param step The maximal number of old slots to move.
+     */
+    void _migrate(int step)
+    {
+        if (!_resizing())
+        {
+            return;
+        }
+        int mask = (int) _oldSlots.size() - 1;
+        EX3_HASHMAP_STAT(
+            _counters.maxMigrated.raise((uint64_t) std::min(step, mask + 1 - _migrated));)
+        for ( ; step > 0 && _migrated <= mask; step--, _migrated++)
+        {
+            Slot& slot = _oldSlots[(_migrateStart + _migrated) & mask];
+            if (slot.distAndFingerprint != 0)
+            {
+                _indexEntry(slot.entry, _entryHash(slot.entry));
+                slot = {0, 0};
+            }
+        }
+        if (_migrated > mask)
+        {
+            _oldSlots.clear();
+            _oldSlots.shrink_to_fit();
+        }
+    }
 
     /**
-     * Calculate the hash code of the given key.
-     * @param key The key to find the hash code.
-     * @return The hash code of the key.
+     * @return The number of old slots every insert or erase has to move, so the resize that just
+     * started ends before an insert or an erase can start the next one.
      */
-    int _hashCode(const KeyT& key) const
+    int _stepToFinishMigration() const
     {
-        return _hashFunc(key) & (_capacity - 1);
+        // The number of inserts until the one that grows the map and of erases until the one that
+        // shrinks it, less one so a rounding of the load factors can't make either one too many.
+        int inserts = (int) (_upperLoadFactor * _capacity) - size() - 1;
+        int erases = size() - (int) std::ceil(_lowerLoadFactor * _capacity);
+        int operations = std::max(std::min(inserts, erases), 1);
+        return ((int) _oldSlots.size() + operations - 1) / operations;
     }
 
     /**
-     * Resize the map to the given new capacity, andrehash all the pairs that appeared in the old
-     * map.
+     * Resize the map to the given new capacity. The pairs themselves stay in place, only the index
+     * table is rebuilt. Without incremental resizing all the pairs are rehashed at once; otherwise
+     * the old table is kept, and every following insert or erase moves a bounded number of its
+     * slots to the new one.
      * @param newCapacity the new capacity of the map.
      */
     void _resize(const int& newCapacity)
     {
-        bucket *newMap = new bucket[newCapacity];
-        int oldCapacity = _capacity;
+        EX3_HASHMAP_STAT(_counters.resizes.add(1);)
+        EX3_HASHMAP_STAT(ResizeTimer timer(_counters.resizeNs, _counters.maxResizeNs);)
+        _migrate((int) _oldSlots.size());
         _capacity = newCapacity;
-        for (int i = 0; i < oldCapacity; i++)
+        if (_resizeStep > 0 && !_entries.empty())
         {
-            for (pair curPair: _map[i])
+            _oldSlots.swap(_slots);
+            _slots.assign(_capacity, {0, 0});
+            // Moving starts from an empty slot, so no cluster of the old table wraps around the
+            // slots that were already moved.
+            _migrateStart = 0;
+            while (_oldSlots[_migrateStart].distAndFingerprint != 0)
             {
-                newMap[_hashCode(curPair.first)].push_back(curPair);
+                _migrateStart++;
             }
+            _migrated = 0;
+            _migrateStep = std::max(_resizeStep, _stepToFinishMigration());
+            return;
+        }
+        _slots.assign(_capacity, {0, 0});
+        for (uint32_t i = 0; i < _entries.size(); i++)
+        {
+            _indexEntry(i, _entryHash(i));
         }
-        std::swap(_map, newMap);
-        delete[] newMap;
     }
 
     /**
@@ -99,32 +1053,25 @@ class HashMap
     class const_iterator
     {
     private:
+        friend class HashMap;
         const HashMap *_hashMap;
-        int _curBucket;
-        int _cellInBucket;
+        int _index;
 
     public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = pair;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const pair *;
+        using reference = const pair&;
 
         /**
-         * The constructor. Check what is the first place after the given (bucket, cell) that is not
-         * empty, and put it as the cell and bucket of the iterator.
+         * The constructor.
          * @param hashMap A pointer to HashMap object.
-         * @param bucket The current bucket to start the iterator from (default=0).
-         * @param cell The current cell in the given bucket to start the iterator from (default=0).
+         * @param index The index of the pair to start the iterator from (default=0).
          */
-        explicit const_iterator(const HashMap *hashMap, int bucket = 0, int cell = 0) :
+        explicit const_iterator(const HashMap *hashMap, int index = 0) :
             _hashMap(hashMap),
-            _curBucket(bucket),
-            _cellInBucket(cell)
-        {
-            if (!_hashMap->empty())
-            {
-                while (_hashMap->_map[_curBucket].empty() && _curBucket < _hashMap->capacity())
-                {
-                    _curBucket++;
-                }
-            }
-        }
+            _index(index) {}
 
         /**
          * Move the iterator to point on the next pair in the map.
@@ -132,18 +1079,7 @@ class HashMap
          */
         const_iterator& operator++()
         {
-            _cellInBucket++;
-            if (_cellInBucket == (int)_hashMap->_map[_curBucket].size())
-            {
-                while (_hashMap->_map[++_curBucket].empty())
-                {
-                    if (_curBucket == _hashMap->capacity())
-                    {
-                        break;
-                    }
-                }
-                _cellInBucket = 0;
-            }
+            _index++;
             return *this;
         }
 
@@ -164,7 +1100,7 @@ class HashMap
          */
         const pair& operator*() const
         {
-            return (_hashMap->_map[_curBucket][_cellInBucket]);
+            return _hashMap->_entries[_index];
         }
 
         /**
@@ -172,167 +1108,528 @@ class HashMap
          */
         const pair *operator->() const
         {
-            return &(_hashMap->_map[_curBucket][_cellInBucket]);
+            return &(_hashMap->_entries[_index]);
+        }
+
+        /**
+         * Compare between this iterator to the given one.
+         * @param other iterator object to compare.
+         * @return True if the two operators are equal, false otherwise.
+         */
+        bool operator==(const const_iterator& other) const
+        {
+            return (_hashMap == other._hashMap && _index == other._index);
+        }
+
+        /**
+         * Compare between this iterator to the given one.
+         * @param other iterator object to compare.
+         * @return True if the two operators are defferent, false otherwise.
+         */
+        bool operator!=(const const_iterator& other) const
+        {
+            return (!(*this == other));
+        }
+
+    };
+
+    /**
+     * Iterator nested class, that allows to change the values of the pairs. The key of a pair must
+     * not be changed through it.
+     */
+    class iterator
+    {
+    private:
+        friend class HashMap;
+        HashMap *_hashMap;
+        int _index;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = pair;
+        using difference_type = std::ptrdiff_t;
+        using pointer = pair *;
+        using reference = pair&;
+
+        /**
+         * The constructor.
+         * @param hashMap A pointer to HashMap object.
+         * @param index The index of the pair to start the iterator from (default=0).
+         */
+        explicit iterator(HashMap *hashMap, int index = 0) :
+            _hashMap(hashMap),
+            _index(index) {}
+
+        /**
+         * @return A const iterator that points to the same pair.
+         */
+        operator const_iterator() const
+        {
+            return const_iterator(_hashMap, _index);
+        }
+
+        /**
+         * Move the iterator to point on the next pair in the map.
+         * @return The iterator after the change.
+         */
+        iterator& operator++()
+        {
+            _index++;
+            return *this;
+        }
+
+        /**
+         * Move the iterator to point on the next pair in the map.
+         * @return The iterator before the change.
+         */
+        const iterator operator++(int)
+        {
+            iterator temp = *this;
+            ++(*this);
+            return temp;
+        }
+
+        /**
+         * Dereference on the iterator.
+         * @return Reference to the pair the iterator points to.
+         */
+        pair& operator*() const
+        {
+            return _hashMap->_entries[_index];
+        }
+
+        /**
+         * @return Pointer to the pair the iterator points to.
+         */
+        pair *operator->() const
+        {
+            return &(_hashMap->_entries[_index]);
+        }
+
+        /**
+         * Compare between this iterator to the given one.
+         * @param other iterator object to compare.
+         * @return True if the two operators are equal, false otherwise.
+         */
+        bool operator==(const iterator& other) const
+        {
+            return (_hashMap == other._hashMap && _index == other._index);
         }
 
         /**
          * Compare between this iterator to the given one.
          * @param other iterator object to compare.
+         * @return True if the two operators are defferent, false otherwise.
+         */
+        bool operator!=(const iterator& other) const
+        {
+            return (!(*this == other));
+        }
+
+        /**
+         * Compare between this iterator to the given const iterator.
+         * @param other const iterator object to compare.
          * @return True if the two operators are equal, false otherwise.
          */
         bool operator==(const const_iterator& other) const
         {
-            return (_hashMap == other._hashMap && _curBucket == other._curBucket &&
-                    _cellInBucket == other._cellInBucket);
+            return (const_iterator(*this) == other);
+        }
+
+        /**
+         * Compare between this iterator to the given const iterator.
+         * @param other const iterator object to compare.
+         * @return True if the two operators are defferent, false otherwise.
+         */
+        bool operator!=(const const_iterator& other) const
+        {
+            return (!(*this == other));
+        }
+
+    };
+
+public:
+
+    using allocator_type = Allocator;
+
+    /**
+     * Constructor with two arguments. If the given factors are invalid, it will throw an exception.
+     * @param lowerFactor The lower load factor of the map.
+     * @param upperFactor the upper load factor of the map.
+     * @param alloc The allocator of the map (default=Allocator()).
+     */
+    HashMap(double lowerFactor, double upperFactor, const Allocator& alloc = Allocator()) :
+        _capacity(DEF_CAPACITY),
+        _lowerLoadFactor(lowerFactor),
+        _upperLoadFactor(upperFactor),
+        _entries(alloc),
+        _slots(alloc),
+        _hashes(alloc),
+        _oldSlots(alloc)
+        {
+            if (_lowerLoadFactor <= 0 || _lowerLoadFactor >= 1 || _upperLoadFactor <= 0 ||
+                _upperLoadFactor >= 1 || _lowerLoadFactor >= _upperLoadFactor)
+            {
+                throw std::invalid_argument(INVALID_FACTORS);
+            }
+            _slots.assign(_capacity, {0, 0});
+        }
+
+    /**
+     * Default constructor.
+     */
+    HashMap() : HashMap(Allocator()) {}
+
+    /**
+     * Constructor of an empty map that takes all its memory from the given allocator.
+     * @param alloc The allocator of the map.
+     */
+    explicit HashMap(const Allocator& alloc) :
+        _capacity(DEF_CAPACITY),
+        _lowerLoadFactor(DEF_LOWER_FACTOR),
+        _upperLoadFactor(DEF_UPPER_FACTOR),
+        _entries(alloc),
+        _slots(_capacity, {0, 0}, alloc),
+        _hashes(alloc),
+        _oldSlots(alloc) {}
+
+
+    /**
+     * Constructor that gets two vectors (keys and values) and ut them into the map. If the vectors
+     * are in different sizes, it will throw an exception.
+     * @param keys
+     * @param values
+     * @param alloc The allocator of the map (default=Allocator()).
+     */
+    HashMap(const std::vector<KeyT>& keys, const std::vector<ValueT>& values,
+            const Allocator& alloc = Allocator()) : HashMap(alloc)
+    {
+        if (keys.size() != values.size())
+        {
+            throw std::invalid_argument(INVALID_VECTORS);
+        }
+        reserve((int) keys.size());
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            insert_or_assign(keys[i], values[i]);
+        }
+        _shrinkToGrownCapacity();
+    }
+
+    /**
+     * Constructor that gets two vectors (keys and values) and moves them into the map. If the
+     * vectors are in different sizes, it will throw an exception.
+     * @param keys
+     * @param values
+     * @param alloc The allocator of the map (default=Allocator()).
+     */
+    HashMap(std::vector<KeyT>&& keys, std::vector<ValueT>&& values,
+            const Allocator& alloc = Allocator()) : HashMap(alloc)
+    {
+        if (keys.size() != values.size())
+        {
+            throw std::invalid_argument(INVALID_VECTORS);
+        }
+        reserve((int) keys.size());
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            insert_or_assign(std::move(keys[i]), std::move(values[i]));
+        }
+        _shrinkToGrownCapacity();
+    }
+
+    /**
+     * Constructor that gets a range of pairs and puts them into the map. Like the vectors
+     * constructor, a later pair of an existing key replaces its value. If the range can be
+     * measured in advance, the map is sized for it once, and then shrunk back if it had repeated
+     * keys, so it ends with the capacity of a map its pairs were inserted to one at a time.
+     * @param first An iterator to the first pair.
+     * @param last An iterator after the last pair.
+     * @param alloc The allocator of the map (default=Allocator()).
+     */
+    template <typename InputIt,
+              typename = typename std::iterator_traits<InputIt>::iterator_category>
+    HashMap(InputIt first, InputIt last, const Allocator& alloc = Allocator()) : HashMap(alloc)
+    {
+        using category = typename std::iterator_traits<InputIt>::iterator_category;
+        if (std::is_base_of<std::forward_iterator_tag, category>::value)
+        {
+            reserve((int) std::distance(first, last));
+        }
+        for ( ; first != last; ++first)
+        {
+            insert_or_assign(first->first, first->second);
         }
+        _shrinkToGrownCapacity();
+    }
+
+    /**
+     * Copy constructor.
+     * @param other The HashMap object to copy.
+     */
+    HashMap(const HashMap& other) = default;
+
+    /**
+     * Move constructor.
+     * @param other The HashMap object to copy.
+     */
+    HashMap(HashMap && other) noexcept = default;
+
+    /**
+     * HashMap destructor.
+     */
+    ~HashMap() = default;
+
+    /**
+     * @return A copy of the allocator of the map.
+     */
+    allocator_type get_allocator() const
+    {
+        return allocator_type(_entries.get_allocator());
+    }
+
+    /**
+     * @return The current size of the map, the number of elements it contains.
+     */
+    int size() const
+    {
+        return (int) _entries.size();
+    }
+
+    /**
+     * @return The capacity of the map, the number of buckets in the map.
+     */
+    int capacity() const
+    {
+        return _capacity;
+    }
+
+    /**
+     * @return The load factor of the map, the relation between the size and the capacity.
+     */
+    double getLoadFactor() const
+    {
+        return ((double) size()) / _capacity;
+    }
+
+    /**
+     * @return True if the map is empty, false otherwise.
+     */
+    bool empty() const
+    {
+        return _entries.empty();
+    }
 
-        /**
-         * Compare between this iterator to the given one.
-         * @param other iterator object to compare.
-         * @return True if the two operators are defferent, false otherwise.
-         */
-        bool operator!=(const const_iterator& other) const
+    /**
+     * Set how the map resizes. With a step of 0 (the default) a resize rehashes all the pairs at
+     * once. With a positive step the map keeps its old index table when it resizes, and every
+     * following insert or erase moves step slots of it to the new table. The load factors bound the
+     * number of inserts and erases until the next resize can start, so if step is too small to move
+     * the whole table by then, the map moves just enough more slots in every operation (with the
+     * default load factors 4 after a grow and about 8 after a shrink). So an insert or an erase
+     * never has to finish a resize at once, and none of them rehashes more than the larger of
+     * step and that number of pairs. Lookups check both tables until the move ends.
+     * @param step The number of old slots to move in one operation, or 0.
+     */
+    void setIncrementalResize(int step)
+    {
+        _resizeStep = std::max(step, 0);
+        _migrateStep = std::max(_migrateStep, _resizeStep);
+        if (_resizeStep == 0)
         {
-            return (!(*this == other));
+            _migrate((int) _oldSlots.size());
         }
+    }
 
-    };
+    /**
+     * @return The maximal number of old slots an operation moves during a resize, or 0 if the map
+     * resizes all at once.
+     */
+    int resizeStep() const
+    {
+        return _resizeStep;
+    }
 
-public:
+    /**
+     * @return True if an incremental resize is in progress, false otherwise.
+     */
+    bool resizing() const
+    {
+        return _resizing();
+    }
 
     /**
-     * Constructor with two arguments. If the given factors are invalid, it will throw an exception.
-     * @param lowerFactor The lower load factor of the map.
-     * @param upperFactor the upper load factor of the map.
+     * Find the pair of the given key.
+     * @param key The key to find.
+     * @return An iterator to the pair of the key, or end() if the key isn't in the map.
      */
-    HashMap(double lowerFactor, double upperFactor) :
-        _capacity(DEF_CAPACITY),
-        _curSize(DEF_SIZE),
-        _lowerLoadFactor(lowerFactor),
-        _upperLoadFactor(upperFactor),
-        _map(new bucket[_capacity])
-        {
-            if (_lowerLoadFactor <= 0 || _lowerLoadFactor >= 1 || _upperLoadFactor <= 0 ||
-                _upperLoadFactor >= 1 || _lowerLoadFactor >= _upperLoadFactor)
-            {
-                delete[] _map;
-                throw std::invalid_argument(INVALID_FACTORS);
-            }
-        }
+    iterator find(const KeyT& key)
+    {
+        return iterator(this, _findEntry(key));
+    }
 
     /**
-     * Default constructor.
+     * Find the pair of the given key.
+     * @param key The key to find.
+     * @return A const iterator to the pair of the key, or end() if the key isn't in the map.
      */
-    HashMap() :
-        _capacity(DEF_CAPACITY),
-        _curSize(DEF_SIZE),
-        _lowerLoadFactor(DEF_LOWER_FACTOR),
-        _upperLoadFactor(DEF_UPPER_FACTOR),
-        _map(new bucket[_capacity]) {}
+    const_iterator find(const KeyT& key) const
+    {
+        return const_iterator(this, _findEntry(key));
+    }
 
+    /**
+     * Find the pair of the given key, without converting it to KeyT.
+     * @param key The key to find.
+     * @return An iterator to the pair of the key, or end() if the key isn't in the map.
+     */
+    template <typename K, typename H = hasher, typename E = KeyEqual,
+              typename = _ifTransparent<K, H, E>>
+    iterator find(const K& key)
+    {
+        return iterator(this, _findEntry(key));
+    }
 
     /**
-     * Constructor that gets two vectors (keys and values) and ut them into the map. If the vectors
-     * are in different sizes, it will throw an exception.
-     * @param keys
-     * @param values
+     * Find the pair of the given key, without converting it to KeyT.
+     * @param key The key to find.
+     * @return A const iterator to the pair of the key, or end() if the key isn't in the map.
      */
-    HashMap(const std::vector<KeyT>& keys, const std::vector<ValueT>& values) :
-        _capacity(DEF_CAPACITY),
-        _curSize(DEF_SIZE),
-        _lowerLoadFactor(DEF_LOWER_FACTOR),
-        _upperLoadFactor(DEF_UPPER_FACTOR),
-        _map(new bucket[_capacity])
+    template <typename K, typename H = hasher, typename E = KeyEqual,
+              typename = _ifTransparent<K, H, E>>
+    const_iterator find(const K& key) const
     {
-        if (keys.size() != values.size())
-        {
-            delete[] _map;
-            throw std::invalid_argument(INVALID_VECTORS);
-        }
-        try
-        {
-            for (int i = 0; i < keys.size(); i++)
-            {
-                (*this)[keys[i]] = values[i];
-            }
-        }
-        catch (const std::bad_alloc&)
+        return const_iterator(this, _findEntry(key));
+    }
+
+    /**
+     * Find the pairs of many keys. The keys are looked up in batches: all the keys of a batch are
+     * hashed and their slots are prefetched, then the pair of the first matching slot of every key
+     * is prefetched, and only then the probes compare keys, so the cache misses of the batch
+     * overlap instead of following each other.
+     * @param keys The keys to find, KeyT or any type the hash function of the map accepts.
+     * @param count The number of keys.
+     * @param out An output iterator that gets a const iterator for every key, in order, which is
+     * end() if the key isn't in the map.
+     * @return The output iterator after the last result.
+     */
+    template <typename K, typename OutputIt>
+    OutputIt find_many(const K *keys, int count, OutputIt out) const
+    {
+        _forEachFound(keys, count, [this, &out](int entry)
         {
-            delete[] _map;
-            throw;
-        }
+            *out++ = const_iterator(this, entry);
+        });
+        return out;
     }
 
     /**
-     * Copy constructor.
-     * @param other The HashMap object to copy.
+     * Count how many of the given keys are in the map, with batched lookups like find_many.
+     * @param keys The keys to find, KeyT or any type the hash function of the map accepts.
+     * @param count The number of keys.
+     * @return The number of keys that are in the map.
      */
-    HashMap(const HashMap& other) :
-        _capacity(other._capacity),
-        _curSize(other._curSize),
-        _lowerLoadFactor(other._lowerLoadFactor),
-        _upperLoadFactor(other._upperLoadFactor),
-        _map(new bucket[_capacity])
+    template <typename K>
+    int count_many(const K *keys, int count) const
     {
-        for (int i = 0; i < _capacity; i ++)
+        int found = 0;
+        _forEachFound(keys, count, [this, &found](int entry)
         {
-            bucket newBucket(other._map[i]);
-            _map[i] = newBucket;
-        }
+            found += (entry != size());
+        });
+        return found;
     }
 
     /**
-     * Move constructor.
-     * @param other The HashMap object to copy.
+     * If the key doesn't exist in the map, insert a pair of the key and a value constructed in
+     * place from the given arguments. Otherwise nothing is changed, and the arguments are not used.
+     * @param key The key to insert.
+     * @param args The arguments to construct the value from.
+     * @return An iterator to the pair of the key, and true if the pair was inserted.
      */
-    HashMap(HashMap && other) noexcept :
-        _capacity(other._capacity),
-        _curSize(other._curSize),
-        _lowerLoadFactor(other._lowerLoadFactor),
-        _upperLoadFactor(other._upperLoadFactor),
-        _map(other._map)
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const KeyT& key, Args&&... args)
     {
-        other._map = nullptr;
+        std::pair<int, bool> result = _tryEmplace(key, std::forward<Args>(args)...);
+        return std::make_pair(iterator(this, result.first), result.second);
     }
 
     /**
-     * HashMap destructor.
+     * If the key doesn't exist in the map, move it into a new pair with a value constructed in
+     * place from the given arguments. Otherwise nothing is changed, and the key is not moved.
+     * @param key The key to insert.
+     * @param args The arguments to construct the value from.
+     * @return An iterator to the pair of the key, and true if the pair was inserted.
      */
-    ~HashMap()
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(KeyT&& key, Args&&... args)
     {
-        delete[] _map;
+        std::pair<int, bool> result = _tryEmplace(std::move(key), std::forward<Args>(args)...);
+        return std::make_pair(iterator(this, result.first), result.second);
     }
 
     /**
-     * @return The current size of the map, the number of elements it contains.
+     * Like try_emplace, but the key is converted to KeyT only if it has to be inserted.
+     * @param key The key to insert.
+     * @param args The arguments to construct the value from.
+     * @return An iterator to the pair of the key, and true if the pair was inserted.
      */
-    int size() const
+    template <typename K, typename... Args, typename H = hasher, typename E = KeyEqual,
+              typename = _ifTransparent<K, H, E>>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args)
     {
-        return _curSize;
+        std::pair<int, bool> result = _tryEmplace(std::forward<K>(key),
+                                                  std::forward<Args>(args)...);
+        return std::make_pair(iterator(this, result.first), result.second);
     }
 
     /**
-     * @return The capacity of the map, the number of buckets in the map.
+     * Construct a pair from the given arguments, and move it into the map if its key doesn't exist
+     * in the map yet.
+     * @param args The arguments to construct the pair from.
+     * @return An iterator to the pair of the key, and true if the pair was inserted.
      */
-    int capacity() const
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
     {
-        return _capacity;
+        pair newPair(std::forward<Args>(args)...);
+        return try_emplace(std::move(newPair.first), std::move(newPair.second));
     }
 
     /**
-     * @return The load factor of the map, the relation between the size and the capacity.
+     * Insert a pair of the given key and value, or assign the value to the key if it already
+     * exists in the map.
+     * @param key The key to insert.
+     * @param value The value to insert or assign.
+     * @return An iterator to the pair of the key, and true if the pair was inserted.
      */
-    double getLoadFactor() const
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(const KeyT& key, M&& value)
     {
-        return ((double) _curSize) / _capacity;
+        std::pair<iterator, bool> result = try_emplace(key, std::forward<M>(value));
+        if (!result.second)
+        {
+            result.first->second = std::forward<M>(value);
+        }
+        return result;
     }
 
     /**
-     * @return True if the map is empty, false otherwise.
+     * Insert a pair of the given key and value, or assign the value to the key if it already
+     * exists in the map. The key is moved only if it is inserted.
+     * @param key The key to insert.
+     * @param value The value to insert or assign.
+     * @return An iterator to the pair of the key, and true if the pair was inserted.
      */
-    bool empty() const
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(KeyT&& key, M&& value)
     {
-        return (_curSize == 0);
+        std::pair<iterator, bool> result = try_emplace(std::move(key), std::forward<M>(value));
+        if (!result.second)
+        {
+            result.first->second = std::forward<M>(value);
+        }
+        return result;
     }
 
     /**
@@ -344,17 +1641,7 @@ public:
      */
     bool insert(const KeyT& key, const ValueT& value)
     {
-        if (containsKey(key))
-        {
-            return false;
-        }
-        _curSize++;
-        if (getLoadFactor() > _upperLoadFactor)
-        {
-            _resize(_capacity * RESIZE_FACTOR);
-        }
-        _map[_hashCode(key)].push_back(pair(key, value));
-        return true;
+        return _tryEmplace(key, value).second;
     }
 
     /**
@@ -364,14 +1651,19 @@ public:
      */
     bool containsKey(const KeyT& key) const
     {
-        for (pair curPair : _map[_hashCode(key)])
-        {
-            if (curPair.first == key)
-            {
-                return true;
-            }
-        }
-        return false;
+        return _findEntry(key) != size();
+    }
+
+    /**
+     * Check if the map contains the given key, without converting it to KeyT.
+     * @param key the key to check.
+     * @return true if the key is in the map, false otherwise.
+     */
+    template <typename K, typename H = hasher, typename E = KeyEqual,
+              typename = _ifTransparent<K, H, E>>
+    bool containsKey(const K& key) const
+    {
+        return _findEntry(key) != size();
     }
 
     /**
@@ -381,14 +1673,19 @@ public:
      */
     ValueT& at(const KeyT& key)
     {
-        for (int i = 0; i < _map[_hashCode(key)].size(); i++)
-        {
-            if (_map[_hashCode(key)][i].first == key)
-            {
-                return _map[_hashCode(key)][i].second;
-            }
-        }
-        throw std::invalid_argument(INVALID_KEY);
+        return _entries[_checkedEntry(key)].second;
+    }
+
+    /**
+     * throw exception if the key doesn't exist in the map. The key isn't converted to KeyT.
+     * @param key The key to check.
+     * @return The value of the given key.
+     */
+    template <typename K, typename H = hasher, typename E = KeyEqual,
+              typename = _ifTransparent<K, H, E>>
+    ValueT& at(const K& key)
+    {
+        return _entries[_checkedEntry(key)].second;
     }
 
     /**
@@ -398,14 +1695,19 @@ public:
      */
     const ValueT& at(const KeyT& key) const
     {
-        for (int i = 0; i < _map[_hashCode(key)].size(); i++)
-        {
-            if (_map[_hashCode(key)][i].first == key)
-            {
-                return _map[_hashCode(key)][i].second;
-            }
-        }
-        throw std::invalid_argument(INVALID_KEY);
+        return _entries[_checkedEntry(key)].second;
+    }
+
+    /**
+     * throw exception if the key doesn't exist in the map. The key isn't converted to KeyT.
+     * @param key The key to check.
+     * @return The value of the given key.
+     */
+    template <typename K, typename H = hasher, typename E = KeyEqual,
+              typename = _ifTransparent<K, H, E>>
+    const ValueT& at(const K& key) const
+    {
+        return _entries[_checkedEntry(key)].second;
     }
 
     /**
@@ -414,91 +1716,201 @@ public:
      * @return True if the erase succeeded, false otherwise.
      */
     bool erase(const KeyT& key)
+    {
+        return _erase(key);
+    }
+
+    /**
+     * If the key exist in the map, it will erase it. The key isn't converted to KeyT.
+     * @param key The key to erase.
+     * @return True if the erase succeeded, false otherwise.
+     */
+    template <typename K, typename H = hasher, typename E = KeyEqual,
+              typename = _ifTransparent<K, H, E>>
+    bool erase(const K& key)
+    {
+        return _erase(key);
+    }
+
+    /**
+     * Erase the pair the given iterator points to, without searching for its key. The last pair of
+     * the map is moved into its place, so erasing while iterating visits every pair once:
+     * for (auto it = map.begin(); it != map.end(); ) it = cond(*it) ? map.erase(it) : ++it;
+     * @param pos An iterator to a pair in the map.
+     * @return An iterator to the pair that follows the erased one in the iteration.
+     */
+    iterator erase(const_iterator pos)
+    {
+        _eraseEntry((uint32_t) pos._index);
+        return iterator(this, pos._index);
+    }
+
+    /**
+     * Erase the pair the given iterator points to, without searching for its key.
+     * @param pos An iterator to a pair in the map.
+     * @return An iterator to the pair that follows the erased one in the iteration.
+     */
+    iterator erase(iterator pos)
+    {
+        return erase(const_iterator(pos));
+    }
+
+    /**
+     * Throws an exception if the key doesn't exist in the map.
+     * @param key The key to check the size of it's bucket.
+     * @return The size of the bucket that contains the given key.
+     */
+    int bucketSize(const KeyT& key) const
     {
         if (!containsKey(key))
         {
-            return false;
-
+            throw std::invalid_argument(INVALID_KEY);
         }
-        auto vecIter = _map[_hashCode(key)].begin();
-        while (vecIter->first != key)
+        int index = _hashCode(key), count = 0;
+        if (_resizing())
         {
-            vecIter++;
+            // Some pairs of the bucket may still be in the old index table.
+            for (uint32_t i = 0; i < _entries.size(); i++)
+            {
+                count += (_bucketOf(_entryHash(i)) == index);
+            }
+            return count;
         }
-        _curSize--;
-        if (getLoadFactor() < _lowerLoadFactor && _capacity > MIN_CAPACITY)
+        // The pairs of a bucket are consecutive, and they are the ones that are exactly as far
+        // from the bucket as the probe is.
+        for (uint32_t dist = DIST_INC; _slots[index].distAndFingerprint >= dist; dist += DIST_INC)
         {
-            _resize(_capacity / RESIZE_FACTOR);
+            if ((_slots[index].distAndFingerprint & ~FINGERPRINT_MASK) == dist)
+            {
+                count++;
+            }
+            index = _nextSlot(_slots, index);
         }
-        _map[_hashCode(key)].erase(vecIter);
-        return true;
+        return count;
     }
 
+#ifdef HASHMAP_STATS
     /**
-     * Throws an exception if the key doesn't exist in the map.
-     * @param key The key to check the size of it's bucket.
-     * @return The size of the bucket that contains the given key.
+     * Only with HASHMAP_STATS defined. The lookups are the calls of find, containsKey, at,
+     * find_many, count_many and the const operator[]; their probe lengths are the ones in the
+     * current index table. The resize time of an incremental resize is the time of its start.
+     * @return A snapshot of the statistics of the map.
      */
-    int bucketSize(const KeyT& key) const
+    HashMapStats stats() const
     {
-        if (containsKey(key))
+        HashMapStats stats;
+        stats.size = size();
+        stats.capacity = _capacity;
+        stats.loadFactor = getLoadFactor();
+        std::vector<int> bucketKeys(_capacity, 0);
+        for (uint32_t i = 0; i < _entries.size(); i++)
+        {
+            bucketKeys[_bucketOf(_entryHash(i))]++;
+        }
+        for (int keys : bucketKeys)
         {
-            return _map[_hashCode(key)].size();
+            if ((size_t) keys >= stats.bucketHistogram.size())
+            {
+                stats.bucketHistogram.resize(keys + 1, 0);
+            }
+            stats.bucketHistogram[keys]++;
         }
-        throw std::invalid_argument(INVALID_KEY);
+        stats.hits = _counters.hits.get();
+        stats.hitProbes = _counters.hitProbes.get();
+        stats.maxHitProbe = _counters.maxHitProbe.get();
+        stats.misses = _counters.misses.get();
+        stats.missProbes = _counters.missProbes.get();
+        stats.maxMissProbe = _counters.maxMissProbe.get();
+        stats.resizes = _counters.resizes.get();
+        stats.resizeNs = _counters.resizeNs.get();
+        stats.maxResizeNs = _counters.maxResizeNs.get();
+        stats.maxMigrated = _counters.maxMigrated.get();
+        stats.bytes = _entries.capacity() * sizeof(pair) + _hashes.capacity() * sizeof(size_t) +
+                      (_slots.capacity() + _oldSlots.capacity()) * sizeof(Slot);
+        return stats;
     }
 
     /**
-     * Clear the map, erase all the pairs in it but doesn't change the other data members.
+     * Only with HASHMAP_STATS defined. Write the statistics of the map to the given stream.
+     * @param out The stream.
+     * @param format Readable text lines, or one JSON object (default=STATS_TEXT).
      */
-    void clear()
+    void dumpStats(std::ostream& out, StatsFormat format = STATS_TEXT) const
     {
-        for (int i = 0; i < _capacity; i ++)
+        stats().dump(out, format);
+    }
+
+    /**
+     * Only with HASHMAP_STATS defined. Zero the lookup and resize counters of the map.
+     */
+    void resetStats()
+    {
+        _counters = StatsCounters();
+    }
+#endif
+
+    /**
+     * Make sure the map can hold the given number of pairs without resizing (until the next
+     * erase), by growing it at once to the capacity the pairs need.
+     * @param count The number of pairs to make room for.
+     */
+    void reserve(int count)
+    {
+        _entries.reserve(count);
+        if (StoreHash)
+        {
+            _hashes.reserve(count);
+        }
+        int newCapacity = std::max(_capacity, _capacityFor(count));
+        if (newCapacity != _capacity)
         {
-            _map[i].clear();
+            _resize(newCapacity);
         }
-        _curSize = 0;
     }
 
     /**
-     * Copy assignment.
-     * @param other HashMap object to copy.
-     * @return This HashMap object, after the copy.
+     * Resize the map to the smallest power of two buckets that is at least the given number, and
+     * that holds the current pairs within the upper load factor.
+     * @param buckets The minimal number of buckets.
      */
-    HashMap& operator=(const HashMap& other)
+    void rehash(int buckets)
     {
-        if (this != &other)
+        int newCapacity = std::max(_capacityFor(size()), MIN_CAPACITY);
+        while (newCapacity < buckets)
         {
-            _capacity = other.capacity();
-            _curSize = other.size();
-            _lowerLoadFactor = other._lowerLoadFactor;
-            _upperLoadFactor = other._upperLoadFactor;
-            delete[] _map;
-            _map = new bucket[_capacity];
-            for (int i = 0; i < _capacity; i ++)
-            {
-                bucket newBucket(other._map[i]);
-                _map[i] = newBucket;
-            }
+            newCapacity *= RESIZE_FACTOR;
         }
-        return *this;
+        if (newCapacity != _capacity)
+        {
+            _resize(newCapacity);
+        }
+    }
+
+    /**
+     * Clear the map, erase all the pairs in it but doesn't change the other data members.
+     */
+    void clear()
+    {
+        _entries.clear();
+        _hashes.clear();
+        _oldSlots.clear();
+        _oldSlots.shrink_to_fit();
+        _slots.assign(_capacity, {0, 0});
     }
 
+    /**
+     * Copy assignment.
+     * @param other HashMap object to copy.
+     * @return This HashMap object, after the copy.
+     */
+    HashMap& operator=(const HashMap& other) = default;
+
     /**
      * Move assignment.
      * @param other HashMap object to move.
      * @return This HashMap object, after the move.
      */
-    HashMap& operator=(HashMap && other) noexcept
-    {
-        _capacity = other._capacity;
-        _curSize = other._curSize;
-        _lowerLoadFactor = other._lowerLoadFactor;
-        _upperLoadFactor = other._upperLoadFactor;
-        _map = other._map;
-        other._map = nullptr;
-        return *this;
-    }
+    HashMap& operator=(HashMap && other) noexcept = default;
 
     /**
      * Undefined if the key doesn't exist in the map.
@@ -507,12 +1919,19 @@ public:
      */
     const ValueT& operator[](const KeyT& key) const
     {
-        try
-        {
-            return at(key);
+        return _entries[_findEntry(key)].second;
+    }
 
-        }
-        catch (const std::invalid_argument&) {}
+    /**
+     * Undefined if the key doesn't exist in the map. The key isn't converted to KeyT.
+     * @param key The key to find it's value.
+     * @return The value that in this key as a const reference.
+     */
+    template <typename K, typename H = hasher, typename E = KeyEqual,
+              typename = _ifTransparent<K, H, E>>
+    const ValueT& operator[](const K& key) const
+    {
+        return _entries[_findEntry(key)].second;
     }
 
     /**
@@ -522,12 +1941,31 @@ public:
      */
     ValueT& operator[](const KeyT& key)
     {
-        if (!containsKey(key))
-        {
-            ValueT value = 0;
-            insert(key, value);
-        }
-        return at(key);
+        return _entries[_tryEmplace(key).first].second;
+    }
+
+    /**
+     * If the key doesn't exist in the, it will create a pair with this key and a default value.
+     * The key is moved only if it is inserted.
+     * @param key The key to find it's value.
+     * @return The value that in this key as a reference.
+     */
+    ValueT& operator[](KeyT&& key)
+    {
+        return _entries[_tryEmplace(std::move(key)).first].second;
+    }
+
+    /**
+     * If the key doesn't exist in the, it will create a pair with a KeyT made from this key and a
+     * default value. Otherwise the key isn't converted to KeyT.
+     * @param key The key to find it's value.
+     * @return The value that in this key as a reference.
+     */
+    template <typename K, typename H = hasher, typename E = KeyEqual,
+              typename = _ifTransparent<K, H, E>>
+    ValueT& operator[](const K& key)
+    {
+        return _entries[_tryEmplace(key).first].second;
     }
 
     /**
@@ -537,20 +1975,18 @@ public:
      */
     bool operator==(const HashMap& other) const
     {
-        if (_curSize != other.size() || _capacity != other.capacity() ||
+        if (size() != other.size() || _capacity != other.capacity() ||
             _lowerLoadFactor != other._lowerLoadFactor ||
             _upperLoadFactor != other._upperLoadFactor)
         {
             return false;
         }
-        for (int i = 0; i < _capacity; i++)
+        for (const pair& curPair : _entries)
         {
-            for (pair curPair : _map[i])
+            int entry = other._findEntry(curPair.first);
+            if (entry == other.size() || !(curPair.second == other._entries[entry].second))
             {
-                if (!other.containsKey(curPair.first) || curPair.second != other.at(curPair.first))
-                {
-                    return false;
-                }
+                return false;
             }
         }
         return true;
@@ -565,6 +2001,14 @@ public:
         return (!(*this == other));
     }
 
+    /**
+     * @return An iterator object to the begin of the map.
+     */
+    iterator begin()
+    {
+        return iterator(this);
+    }
+
     /**
      * @return An iterator object to the begin of the map.
      */
@@ -581,12 +2025,20 @@ public:
         return const_iterator(this);
     }
 
+    /**
+     * @return An iterator object to the end of the map.
+     */
+    iterator end()
+    {
+        return iterator(this, size());
+    }
+
     /**
      * @return An iterator object to the end of the map.
      */
     const_iterator end() const
     {
-        return const_iterator(this, _capacity);
+        return const_iterator(this, size());
     }
 
     /**
@@ -594,9 +2046,17 @@ public:
      */
     const const_iterator cend() const
     {
-        return const_iterator(this, _capacity);
+        return const_iterator(this, size());
     }
 
 };
 
+/**
+ * HashMap that takes all its memory from a std::pmr::memory_resource, like a request-scoped
+ * std::pmr::monotonic_buffer_resource that frees the whole map at once.
+ */
+template <typename KeyT, typename ValueT>
+using PmrHashMap = HashMap<KeyT, ValueT, DefaultHash<KeyT>, std::equal_to<>,
+                           std::pmr::polymorphic_allocator<std::pair<KeyT, ValueT>>>;
+
 #endif //EX3_HASHMAP_HPP
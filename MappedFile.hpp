@@ -0,0 +1,338 @@
+#ifndef EX3_MAPPEDFILE_HPP
+#define EX3_MAPPEDFILE_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Defines the number of bytes that are read at once from a file that can't be mapped.
+ */
+const size_t READ_BLOCK = 1 << 16;
+
+/**
+ * The ways a MappedFile gets the contents of a file.
+ */
+enum FileAccess
+{
+    // Map a regular file, and read any other file into a buffer.
+    ACCESS_MAP,
+    // Map a regular file, and keep any other file open to be read in parts by forEachPart.
+    ACCESS_STREAM,
+    // Read any file into a buffer, so writing to the file later can't change or truncate it.
+    ACCESS_COPY,
+    // Keep any file open to be read in parts by forEachPart, so truncating it can't raise SIGBUS.
+    ACCESS_READ
+};
+
+/**
+ * The read-only contents of a file, as a std::string_view.
+ * A regular file is mapped into memory, so its bytes are read straight from the page cache without
+ * being copied, and the kernel is told it will be read sequentially. Any other file (like a pipe)
+ * or a file that can't be mapped is read into a buffer instead, or, if the file is opened to be
+ * streamed, is kept open and read one READ_BLOCK at a time by forEachPart, so it takes a constant
+ * amount of memory whatever its size.
+ * A mapped file must be replaced by renaming a new file over it, never rewritten in place: the
+ * mapping shows every write to the file, and reading a page past the end of a truncated file
+ * raises SIGBUS. A file that is kept for long while others may write it should be copied.
+ */
+class MappedFile
+{
+    const char *_data;
+    size_t _size;
+    bool _mapped;
+    bool _valid;
+    // The descriptor of a streamed file that wasn't read yet, or -1.
+    int _fd;
+    std::vector<char> _buffer;
+
+    /**
+     * Map the given file into memory.
+     * @param fd The file descriptor.
+     * @param size The size of the file.
+     * @return True if the file was mapped, false otherwise.
+     */
+    bool _map(int fd, size_t size)
+    {
+        void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            return false;
+        }
+        madvise(address, size, MADV_SEQUENTIAL);
+        _data = (const char *) address;
+        _size = size;
+        _mapped = true;
+        return true;
+    }
+
+    /**
+     * Read the whole given file into the buffer.
+     * @param fd The file descriptor.
+     * @param size The expected size of the file, or 0 if it isn't known.
+     * @return True if the whole file was read, false otherwise.
+     */
+    bool _read(int fd, size_t size)
+    {
+        _buffer.reserve(size + READ_BLOCK);
+        size_t used = 0;
+        while (true)
+        {
+            _buffer.resize(used + READ_BLOCK);
+            ssize_t count = ::read(fd, _buffer.data() + used, READ_BLOCK);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count < 0)
+            {
+                return false;
+            }
+            if (count == 0)
+            {
+                break;
+            }
+            used += (size_t) count;
+        }
+        _buffer.resize(used);
+        _data = _buffer.data();
+        _size = used;
+        return true;
+    }
+
+    /**
+     * Unmap the file, if it's mapped.
+     */
+    void _release()
+    {
+        if (_mapped)
+        {
+            munmap((void *) _data, _size);
+        }
+        if (_fd >= 0)
+        {
+            close(_fd);
+        }
+        _data = nullptr;
+        _size = 0;
+        _mapped = false;
+        _valid = false;
+        _fd = -1;
+        _buffer.clear();
+    }
+
+public:
+
+    /**
+     * Constructor of an empty file, that is invalid.
+     */
+    MappedFile() :
+        _data(nullptr),
+        _size(0),
+        _mapped(false),
+        _valid(false),
+        _fd(-1)
+    {
+    }
+
+    /**
+     * Open the file of the given path and map or read it. Check the object to know if it succeeded.
+     * @param path The path of the file.
+     * @param access How to get the contents of the file (default=ACCESS_MAP).
+     */
+    explicit MappedFile(const char *path, FileAccess access = ACCESS_MAP) :
+        _data(nullptr),
+        _size(0),
+        _mapped(false),
+        _valid(false),
+        _fd(-1)
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat info;
+        bool regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+        if (regular && info.st_size == 0)
+        {
+            _valid = true;
+        }
+        else if (regular && (access == ACCESS_MAP || access == ACCESS_STREAM) &&
+                 _map(fd, (size_t) info.st_size))
+        {
+            _valid = true;
+        }
+        else if (access == ACCESS_STREAM || access == ACCESS_READ)
+        {
+            _valid = true;
+            _fd = fd;
+            return;
+        }
+        else
+        {
+            _valid = _read(fd, regular ? (size_t) info.st_size : 0);
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * Move constructor.
+     * @param other The file to move from, that is left invalid.
+     */
+    MappedFile(MappedFile&& other) noexcept :
+        _data(other._data),
+        _size(other._size),
+        _mapped(other._mapped),
+        _valid(other._valid),
+        _fd(other._fd),
+        _buffer(std::move(other._buffer))
+    {
+        other._data = nullptr;
+        other._size = 0;
+        other._mapped = false;
+        other._valid = false;
+        other._fd = -1;
+    }
+
+    /**
+     * Move assignment.
+     * @param other The file to move from, that is left invalid.
+     * @return This file.
+     */
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            _release();
+            _data = other._data;
+            _size = other._size;
+            _mapped = other._mapped;
+            _valid = other._valid;
+            _fd = other._fd;
+            _buffer = std::move(other._buffer);
+            other._data = nullptr;
+            other._size = 0;
+            other._mapped = false;
+            other._valid = false;
+            other._fd = -1;
+        }
+        return *this;
+    }
+
+    /**
+     * Destructor.
+     */
+    ~MappedFile()
+    {
+        _release();
+    }
+
+    /**
+     * @return True if the file was opened and read, false otherwise.
+     */
+    explicit operator bool() const
+    {
+        return _valid;
+    }
+
+    /**
+     * @return True if the file is mapped into memory, false if it was read into a buffer.
+     */
+    bool mapped() const
+    {
+        return _mapped;
+    }
+
+    /**
+     * @return True if the file is streamed, so its contents are only given by forEachPart, false
+     * if view() has them.
+     */
+    bool streamed() const
+    {
+        return _fd >= 0;
+    }
+
+    /**
+     * Call the given function with the contents of the file, in order: the whole view() at once,
+     * or every block that is read from a streamed file, until the function returns false. A
+     * streamed file can be read only once, and is closed without reading its rest when the
+     * function stops it.
+     * @param func A function that gets a std::string_view of a part, and returns true to get the
+     * next part or false to stop.
+     * @return True if the file was read without an error (to its end or until the function
+     * stopped), false otherwise.
+     */
+    template <typename F>
+    bool forEachPart(F func)
+    {
+        if (_fd < 0)
+        {
+            func(view());
+            return _valid;
+        }
+        _buffer.resize(READ_BLOCK);
+        bool read = true;
+        while (true)
+        {
+            ssize_t count = ::read(_fd, _buffer.data(), READ_BLOCK);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                read = count == 0;
+                break;
+            }
+            if (!func(std::string_view(_buffer.data(), (size_t) count)))
+            {
+                break;
+            }
+        }
+        close(_fd);
+        _fd = -1;
+        _valid = read;
+        return read;
+    }
+
+    /**
+     * Tell the kernel how the file will be read, if it's mapped.
+     * @param advice The madvise advice, like MADV_RANDOM.
+     */
+    void advise(int advice) const
+    {
+        if (_mapped && _size > 0)
+        {
+            madvise((void *) _data, _size, advice);
+        }
+    }
+
+    /**
+     * @return The contents of the file.
+     */
+    std::string_view view() const
+    {
+        return std::string_view(_data, _size);
+    }
+
+    /**
+     * @return The size of the file.
+     */
+    size_t size() const
+    {
+        return _size;
+    }
+
+};
+
+#endif //EX3_MAPPEDFILE_HPP
@@ -0,0 +1,339 @@
+#ifndef EX3_MATCHREPORT_HPP
+#define EX3_MATCHREPORT_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "AhoCorasick.hpp"
+
+/**
+ * Defines the default maximal number of offsets that are kept for every phrase of a report.
+ */
+const size_t DEF_MAX_OFFSETS = 16;
+/**
+ * Defines the separator of the columns of a TSV report.
+ */
+const char REPORT_COLUMN = '\t';
+/**
+ * Defines the separator of the offsets of a phrase in a TSV report.
+ */
+const char* OFFSET_SEPARATOR = ",";
+/**
+ * Defines the hexadecimal digits of an escaped byte in a JSON string.
+ */
+const char* HEX_DIGITS = "0123456789abcdef";
+
+/**
+ * The formats a report can be written in.
+ */
+enum ReportFormat
+{
+    REPORT_TSV,
+    REPORT_JSON
+};
+
+/**
+ * @param text A text.
+ * @param i The index of a byte of the text that isn't ASCII.
+ * @return The length of the UTF-8 sequence that starts at the byte, or 0 if no valid one does.
+ */
+inline size_t utf8SequenceLength(std::string_view text, size_t i)
+{
+    unsigned char first = (unsigned char) text[i];
+    size_t length = first >= 0xC2 && first <= 0xDF ? 2 : first >= 0xE0 && first <= 0xEF ? 3 :
+                    first >= 0xF0 && first <= 0xF4 ? 4 : 0;
+    if (length == 0 || i + length > text.size())
+    {
+        return 0;
+    }
+    // The second byte of a few first bytes has a narrower range, so no code point has two
+    // encodings and no surrogate or code point above U+10FFFF is encoded.
+    unsigned char second = (unsigned char) text[i + 1];
+    unsigned char low = first == 0xE0 ? 0xA0 : first == 0xF0 ? 0x90 : 0x80;
+    unsigned char high = first == 0xED ? 0x9F : first == 0xF4 ? 0x8F : 0xBF;
+    if (second < low || second > high)
+    {
+        return 0;
+    }
+    for (size_t k = 2; k < length; k++)
+    {
+        if (((unsigned char) text[i + k] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+    }
+    return length;
+}
+
+/**
+ * Write the given text as a JSON string, with quotes. The text is expected to be UTF-8: its valid
+ * sequences are written as they are, and every other byte that isn't printable ASCII (a control
+ * byte, DEL or a byte of an invalid sequence) is written as the escaped code point of its value,
+ * so the string is valid JSON whatever the text is.
+ * @param out The stream to write to.
+ * @param text The text.
+ */
+inline void writeJsonString(std::ostream& out, std::string_view text)
+{
+    out << '"';
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        unsigned char c = (unsigned char) text[i];
+        size_t length = c >= 0x80 ? utf8SequenceLength(text, i) : 0;
+        if (c == '"' || c == '\\')
+        {
+            out << '\\' << (char) c;
+        }
+        else if (c < 0x20 || c == 0x7F || (c >= 0x80 && length == 0))
+        {
+            out << "\\u00" << HEX_DIGITS[c >> 4] << HEX_DIGITS[c & 0x0F];
+        }
+        else if (length > 0)
+        {
+            out << text.substr(i, length);
+            i += length - 1;
+        }
+        else
+        {
+            out << (char) c;
+        }
+    }
+    out << '"';
+}
+
+/**
+ * Write the given text as a field of a TSV line, with its tabs, ends of lines and backslashes
+ * escaped.
+ * @param out The stream to write to.
+ * @param text The text.
+ */
+inline void writeTsvField(std::ostream& out, std::string_view text)
+{
+    for (char c : text)
+    {
+        switch (c)
+        {
+            case '\t':
+                out << "\\t";
+                break;
+            case '\n':
+                out << "\\n";
+                break;
+            case '\r':
+                out << "\\r";
+                break;
+            case '\\':
+                out << "\\\\";
+                break;
+            default:
+                out << c;
+        }
+    }
+}
+
+/**
+ * The phrases that were found in a message: how many times every phrase occurs, and the offsets of
+ * its first occurrences. A report is filled by a MessageScorer during its scan, and is made to be
+ * reused for the messages of one thread: its counters are allocated once for all the phrases of the
+ * automaton, and clearing it only touches the phrases that were found.
+ */
+class MatchReport
+{
+    const AhoCorasick& _matcher;
+    size_t _maxOffsets;
+    std::vector<int64_t> _counts;
+    // The phrases whose count isn't 0, in the order they were first found.
+    std::vector<int32_t> _found;
+    // The phrase and the offset of the first _maxOffsets occurrences of every phrase.
+    std::vector<std::pair<int32_t, int64_t>> _offsets;
+    std::vector<int32_t> _emptyPhrases;
+
+    /**
+     * @param phrase The index of a phrase.
+     * @return The total score of the occurrences of the phrase.
+     */
+    int64_t _contribution(int32_t phrase) const
+    {
+        return _counts[phrase] * _matcher.phraseScore(phrase);
+    }
+
+    /**
+     * Add an occurrence of a phrase.
+     * @param phrase The index of the phrase.
+     * @param start The offset of the occurrence in the message.
+     */
+    void _add(int32_t phrase, int64_t start)
+    {
+        int64_t& count = _counts[phrase];
+        if (count == 0)
+        {
+            _found.push_back(phrase);
+        }
+        if ((uint64_t) count < _maxOffsets)
+        {
+            _offsets.emplace_back(phrase, start);
+        }
+        count++;
+    }
+
+public:
+
+    /**
+     * Constructor.
+     * @param matcher The automaton of the spam phrases, that must live longer than the report.
+     * @param maxOffsets The maximal number of offsets that are kept for every phrase
+     * (default=DEF_MAX_OFFSETS).
+     */
+    explicit MatchReport(const AhoCorasick& matcher, size_t maxOffsets = DEF_MAX_OFFSETS) :
+        _matcher(matcher),
+        _maxOffsets(maxOffsets),
+        _counts(matcher.phrases(), 0)
+    {
+        for (size_t i = 0; i < matcher.phrases(); i++)
+        {
+            if (matcher.phrase(i).empty())
+            {
+                _emptyPhrases.push_back((int32_t) i);
+            }
+        }
+    }
+
+    /**
+     * Start the report of a new message.
+     */
+    void clear()
+    {
+        for (int32_t phrase : _found)
+        {
+            _counts[phrase] = 0;
+        }
+        _found.clear();
+        _offsets.clear();
+    }
+
+    /**
+     * Add an occurrence of a (non-empty) phrase.
+     * @param phrase The index of the phrase.
+     * @param end The offset in the message of the byte after the end of the occurrence.
+     */
+    void add(size_t phrase, int64_t end)
+    {
+        _add((int32_t) phrase, end - (int64_t) _matcher.phrase(phrase).size());
+    }
+
+    /**
+     * Add the occurrences of the empty phrases, that occur once at every offset of the message and
+     * once after its end.
+     * @param length The length of the message.
+     */
+    void addEmpty(int64_t length)
+    {
+        for (int32_t phrase : _emptyPhrases)
+        {
+            if (_counts[phrase] == 0)
+            {
+                _found.push_back(phrase);
+            }
+            for (int64_t start = 0; start <= length && (uint64_t) start < _maxOffsets; start++)
+            {
+                _offsets.emplace_back(phrase, start);
+            }
+            _counts[phrase] += length + 1;
+        }
+    }
+
+    /**
+     * @param phrase The index of a phrase.
+     * @return The number of occurrences of the phrase in the message.
+     */
+    int64_t count(size_t phrase) const
+    {
+        return _counts[phrase];
+    }
+
+    /**
+     * @return The number of different phrases that were found in the message.
+     */
+    size_t found() const
+    {
+        return _found.size();
+    }
+
+    /**
+     * Write the report of the message, with the phrases that add the most to its score (or take
+     * the most from it) first. A TSV report has a line of the message, the phrase, the number of
+     * occurrences, their score and their offsets for every phrase. A JSON report is one line with
+     * an object of the message, its score and its verdict, and the same for every phrase.
+     * @param out The stream to write to.
+     * @param format The format of the report.
+     * @param message The name of the message, like its path.
+     * @param score The score of the message.
+     * @param verdict The verdict of the message, like SPAM.
+     */
+    void write(std::ostream& out, ReportFormat format, std::string_view message, int64_t score,
+               std::string_view verdict)
+    {
+        std::sort(_found.begin(), _found.end(), [this](int32_t a, int32_t b)
+        {
+            int64_t left = std::abs(_contribution(a)), right = std::abs(_contribution(b));
+            return left != right ? left > right : a < b;
+        });
+        std::stable_sort(_offsets.begin(), _offsets.end(),
+                         [](const std::pair<int32_t, int64_t>& a,
+                            const std::pair<int32_t, int64_t>& b)
+                         {
+                             return a.first < b.first;
+                         });
+        if (format == REPORT_JSON)
+        {
+            out << "{\"message\": ";
+            writeJsonString(out, message);
+            out << ", \"score\": " << score << ", \"verdict\": ";
+            writeJsonString(out, verdict);
+            out << ", \"phrases\": [";
+        }
+        for (size_t i = 0; i < _found.size(); i++)
+        {
+            int32_t phrase = _found[i];
+            if (format == REPORT_JSON)
+            {
+                out << (i == 0 ? "" : ", ") << "{\"phrase\": ";
+                writeJsonString(out, _matcher.phrase(phrase));
+                out << ", \"count\": " << _counts[phrase] << ", \"score\": "
+                    << _contribution(phrase) << ", \"offsets\": [";
+            }
+            else
+            {
+                writeTsvField(out, message);
+                out << REPORT_COLUMN;
+                writeTsvField(out, _matcher.phrase(phrase));
+                out << REPORT_COLUMN << _counts[phrase] << REPORT_COLUMN << _contribution(phrase)
+                    << REPORT_COLUMN;
+            }
+            auto offset = std::lower_bound(_offsets.begin(), _offsets.end(),
+                                           std::make_pair(phrase, INT64_MIN));
+            for (bool first = true; offset != _offsets.end() && offset->first == phrase;
+                 offset++, first = false)
+            {
+                if (!first)
+                {
+                    out << (format == REPORT_JSON ? ", " : OFFSET_SEPARATOR);
+                }
+                out << offset->second;
+            }
+            out << (format == REPORT_JSON ? "]}" : "\n");
+        }
+        if (format == REPORT_JSON)
+        {
+            out << "]}\n";
+        }
+    }
+
+};
+
+#endif //EX3_MATCHREPORT_HPP
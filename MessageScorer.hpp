@@ -0,0 +1,273 @@
+#ifndef EX3_MESSAGESCORER_HPP
+#define EX3_MESSAGESCORER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <string_view>
+#include "AhoCorasick.hpp"
+#include "MatchReport.hpp"
+#include "Simd.hpp"
+
+/**
+ * Defines the number of bytes of a message that are normalized and scanned at once.
+ */
+const size_t SCAN_BLOCK = 4096;
+/**
+ * Defines the end of a line in a message.
+ */
+const char NEW_LINE = '\n';
+/**
+ * Defines the separator that replaces the end of every line of a message (see normalizeByte).
+ */
+const char LINE_SEPARATOR = ' ';
+
+/**
+ * The statistics of the prefilter of the scans of a scorer: the scan of a message jumps over the
+ * bytes no phrase can start at, and a message it jumps over entirely is rejected without being
+ * matched at all.
+ */
+struct PrefilterStats
+{
+    int64_t messages = 0;
+    int64_t rejected = 0;
+    int64_t bytes = 0;
+    int64_t skipped = 0;
+
+    /**
+     * Add the statistics of another scorer.
+     * @param other The statistics to add.
+     */
+    void add(const PrefilterStats& other)
+    {
+        messages += other.messages;
+        rejected += other.rejected;
+        bytes += other.bytes;
+        skipped += other.skipped;
+    }
+
+    /**
+     * @return The part of the messages that were rejected, or 0 if there were none.
+     */
+    double rejectRate() const
+    {
+        return messages == 0 ? 0 : (double) rejected / (double) messages;
+    }
+
+    /**
+     * @return The part of the scanned bytes that were jumped over, or 0 if there were none.
+     */
+    double skipRate() const
+    {
+        return bytes == 0 ? 0 : (double) skipped / (double) bytes;
+    }
+};
+
+/**
+ * Scores a message that is given in parts, in a constant amount of memory.
+ * The message is scored as the lower case text of its lines, each of them followed by a space, like
+ * the lines read by getline. Since the automaton state is kept between the parts, phrases that
+ * cross the end of a part or of a line are found like in the whole text. Every part is normalized
+ * with the widest SIMD kernel of the CPU, one block at a time.
+ * A scorer with a report also adds every phrase it finds to the report, in the same scan.
+ */
+class MessageScorer
+{
+    const AhoCorasick& _matcher;
+    int32_t _state;
+    int64_t _score;
+    int64_t _length;
+    bool _lineOpen;
+    MatchReport *_report;
+    size_t _skipped;
+    PrefilterStats _stats;
+    char _block[SCAN_BLOCK];
+
+    /**
+     * Scan the first given number of bytes of the block.
+     * @param count The number of bytes.
+     */
+    void _scanBlock(size_t count)
+    {
+        if (_report != nullptr)
+        {
+            int64_t offset = _length;
+            MatchReport& report = *_report;
+            _score += _matcher.scanMatches(_block, count, _state, _skipped,
+                                           [&](size_t phrase, size_t end)
+                                           {
+                                               report.add(phrase, offset + (int64_t) end);
+                                           });
+        }
+        else
+        {
+            _score += _matcher.scan(_block, count, _state, _skipped);
+        }
+        _length += (int64_t) count;
+    }
+
+    /**
+     * Add the scan of the message to the prefilter statistics.
+     * @param whole True if the whole message was scanned, false if the scan stopped early.
+     */
+    void _countMessage(bool whole)
+    {
+        _stats.messages++;
+        _stats.rejected += whole && (int64_t) _skipped == _length;
+        _stats.bytes += _length;
+        _stats.skipped += (int64_t) _skipped;
+    }
+
+public:
+
+    /**
+     * Constructor.
+     * @param matcher The automaton of the spam phrases, that must live longer than the scorer.
+     */
+    explicit MessageScorer(const AhoCorasick& matcher) :
+        _matcher(matcher),
+        _state(ROOT_STATE),
+        _score(0),
+        _length(0),
+        _lineOpen(false),
+        _report(nullptr),
+        _skipped(0)
+    {
+    }
+
+    /**
+     * Add the phrases of the following messages to the given report, or stop adding them.
+     * @param report The report, that must live longer than the scorer, or nullptr.
+     */
+    void setReport(MatchReport *report)
+    {
+        _report = report;
+        if (_report != nullptr)
+        {
+            _report->clear();
+        }
+    }
+
+    /**
+     * Start a new message.
+     */
+    void reset()
+    {
+        _state = ROOT_STATE;
+        _score = 0;
+        _length = 0;
+        _lineOpen = false;
+        _skipped = 0;
+        if (_report != nullptr)
+        {
+            _report->clear();
+        }
+    }
+
+    /**
+     * Score the next part of the message.
+     * @param data The bytes of the part, as they are in the message file.
+     * @param length The number of bytes.
+     */
+    void feed(const char *data, size_t length)
+    {
+        if (length == 0)
+        {
+            return;
+        }
+        while (length > 0)
+        {
+            size_t count = length < SCAN_BLOCK ? length : SCAN_BLOCK;
+            normalizeText(data, _block, count);
+            _scanBlock(count);
+            data += count;
+            length -= count;
+        }
+        _lineOpen = data[-1] != NEW_LINE;
+    }
+
+    /**
+     * Decide if a whole message is spam, scanning only as much of it as the decision needs. If no
+     * phrase has a negative score, the scan stops as soon as the score reaches the threshold, or
+     * as soon as the rest of the message can't bring it to the threshold even if every byte ends
+     * in the best state of the automaton. A scorer with a report scans the whole message.
+     * @param message The bytes of the whole message, as they are in the message file.
+     * @param threshold The threshold of a spam message.
+     * @return True if the score of the message reaches the threshold, false otherwise.
+     */
+    bool isSpam(std::string_view message, int64_t threshold)
+    {
+        reset();
+        if (!_matcher.nonNegative() || _report != nullptr)
+        {
+            feed(message.data(), message.size());
+            return finish() >= threshold;
+        }
+        // The length the message will have after the end of its last line becomes a space.
+        int64_t total = (int64_t) message.size() + (!message.empty() && message.back() != NEW_LINE);
+        int64_t emptyTotal = _matcher.emptyScore() * (total + 1);
+        int64_t maxStateScore = _matcher.maxStateScore();
+        while (!message.empty())
+        {
+            size_t count = std::min(message.size(), SCAN_BLOCK);
+            feed(message.data(), count);
+            message.remove_prefix(count);
+            int64_t missing = threshold - _score - emptyTotal;
+            if (missing <= 0)
+            {
+                _countMessage(false);
+                return true;
+            }
+            int64_t remaining = total - _length;
+            if (maxStateScore == 0 || remaining < (missing + maxStateScore - 1) / maxStateScore)
+            {
+                _countMessage(false);
+                return false;
+            }
+        }
+        return finish() >= threshold;
+    }
+
+    /**
+     * @param threshold The threshold of a spam message.
+     * @return True if the parts that were fed already bring the score of the message to the
+     * threshold whatever its rest is, which is only known if no phrase has a negative score and
+     * the scorer has no report, false otherwise.
+     */
+    bool reached(int64_t threshold) const
+    {
+        return _matcher.nonNegative() && _report == nullptr &&
+               _score + _matcher.emptyScore() * (_length + 1) >= threshold;
+    }
+
+    /**
+     * End the message. Call it once, after all the parts were fed.
+     * @return The score of the whole message.
+     */
+    int64_t finish()
+    {
+        if (_lineOpen)
+        {
+            _block[0] = LINE_SEPARATOR;
+            _scanBlock(1);
+            _lineOpen = false;
+        }
+        if (_report != nullptr)
+        {
+            _report->addEmpty(_length);
+        }
+        _countMessage(true);
+        return _score + _matcher.emptyScore() * (_length + 1);
+    }
+
+    /**
+     * @return The prefilter statistics of all the messages this scorer scanned.
+     */
+    const PrefilterStats& prefilterStats() const
+    {
+        return _stats;
+    }
+
+};
+
+#endif //EX3_MESSAGESCORER_HPP
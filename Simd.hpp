@@ -0,0 +1,268 @@
+#ifndef EX3_SIMD_HPP
+#define EX3_SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EX3_X86 1
+#endif
+
+/**
+ * Defines the value that is xor-ed into an upper case ASCII letter to change it to lower case.
+ */
+const unsigned char CASE_BIT = 0x20;
+/**
+ * Defines the value that is xor-ed into an end of line to change it to a space.
+ */
+const unsigned char LINE_TO_SPACE = '\n' ^ ' ';
+
+/**
+ * Normalize the given byte of a message: change an upper case ASCII letter to lower case (like
+ * tolower in the "C" locale), and an end of line to a space.
+ * @param c The byte.
+ * @return The normalized byte.
+ */
+inline unsigned char normalizeByte(unsigned char c)
+{
+    if (c >= 'A' && c <= 'Z')
+    {
+        return c ^ CASE_BIT;
+    }
+    return c == '\n' ? ' ' : c;
+}
+
+/**
+ * Normalize the given bytes of a message one at a time.
+ * @param in The bytes to normalize.
+ * @param out The buffer of the normalized bytes, that may be the same as in.
+ * @param length The number of bytes.
+ */
+inline void normalizeScalar(const char *in, char *out, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        out[i] = (char) normalizeByte((unsigned char) in[i]);
+    }
+}
+
+/**
+ * A set of bytes that can be searched for many bytes at once, by the "shufti" method: a byte is a
+ * candidate if the masks of its low nibble and of its high nibble share a bit. The bit of a byte is
+ * picked by its high nibble modulo 8, so a byte may be a false candidate if the byte with the
+ * other high bit of its high nibble is in the set, but a byte of the set is never missed.
+ */
+struct ByteSet
+{
+    bool contains[256];
+    alignas(16) unsigned char lowMask[16];
+    alignas(16) unsigned char highMask[16];
+    int count;
+
+    /**
+     * Constructor of an empty set.
+     */
+    ByteSet() :
+        contains(),
+        lowMask(),
+        highMask(),
+        count(0)
+    {
+    }
+
+    /**
+     * Add the given byte to the set.
+     * @param c The byte.
+     */
+    void add(unsigned char c)
+    {
+        if (!contains[c])
+        {
+            contains[c] = true;
+            lowMask[c & 0x0F] |= (unsigned char) (1u << ((c >> 4) & 7));
+            highMask[c >> 4] = (unsigned char) (1u << ((c >> 4) & 7));
+            count++;
+        }
+    }
+};
+
+/**
+ * @param text The bytes to search.
+ * @param length The number of bytes.
+ * @param set The set of bytes to find.
+ * @return The index of the first byte of the set in the text, or length if there is none.
+ */
+inline size_t findScalar(const unsigned char *text, size_t length, const ByteSet& set)
+{
+    size_t i = 0;
+    while (i < length && !set.contains[text[i]])
+    {
+        i++;
+    }
+    return i;
+}
+
+#ifdef EX3_X86
+
+/**
+ * Normalize the given bytes of a message 16 at a time, with SSE2 (that every x86-64 CPU has).
+ * @param in The bytes to normalize.
+ * @param out The buffer of the normalized bytes, that may be the same as in.
+ * @param length The number of bytes.
+ */
+__attribute__((target("sse2")))
+inline void normalizeSse2(const char *in, char *out, size_t length)
+{
+    const __m128i shift = _mm_set1_epi8((char) (0x80 - 'A'));
+    const __m128i upperEnd = _mm_set1_epi8((char) (0x80 + 26));
+    const __m128i caseBit = _mm_set1_epi8((char) CASE_BIT);
+    const __m128i newLine = _mm_set1_epi8('\n');
+    const __m128i lineToSpace = _mm_set1_epi8((char) LINE_TO_SPACE);
+    size_t i = 0;
+    for ( ; i + 16 <= length; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (in + i));
+        // 'A'..'Z' are moved to the 26 smallest signed bytes.
+        __m128i upper = _mm_cmplt_epi8(_mm_add_epi8(bytes, shift), upperEnd);
+        __m128i line = _mm_cmpeq_epi8(bytes, newLine);
+        __m128i flip = _mm_or_si128(_mm_and_si128(upper, caseBit),
+                                    _mm_and_si128(line, lineToSpace));
+        _mm_storeu_si128((__m128i *) (out + i), _mm_xor_si128(bytes, flip));
+    }
+    normalizeScalar(in + i, out + i, length - i);
+}
+
+/**
+ * Normalize the given bytes of a message 32 at a time, with AVX2.
+ * @param in The bytes to normalize.
+ * @param out The buffer of the normalized bytes, that may be the same as in.
+ * @param length The number of bytes.
+ */
+__attribute__((target("avx2")))
+inline void normalizeAvx2(const char *in, char *out, size_t length)
+{
+    const __m256i shift = _mm256_set1_epi8((char) (0x80 - 'A'));
+    const __m256i upperEnd = _mm256_set1_epi8((char) (0x80 + 26));
+    const __m256i caseBit = _mm256_set1_epi8((char) CASE_BIT);
+    const __m256i newLine = _mm256_set1_epi8('\n');
+    const __m256i lineToSpace = _mm256_set1_epi8((char) LINE_TO_SPACE);
+    size_t i = 0;
+    for ( ; i + 32 <= length; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *) (in + i));
+        // 'A'..'Z' are moved to the 26 smallest signed bytes.
+        __m256i upper = _mm256_cmpgt_epi8(upperEnd, _mm256_add_epi8(bytes, shift));
+        __m256i line = _mm256_cmpeq_epi8(bytes, newLine);
+        __m256i flip = _mm256_or_si256(_mm256_and_si256(upper, caseBit),
+                                       _mm256_and_si256(line, lineToSpace));
+        _mm256_storeu_si256((__m256i *) (out + i), _mm256_xor_si256(bytes, flip));
+    }
+    normalizeSse2(in + i, out + i, length - i);
+}
+
+/**
+ * Find the first byte of a set 32 bytes at a time, with AVX2.
+ * @param text The bytes to search.
+ * @param length The number of bytes.
+ * @param set The set of bytes to find.
+ * @return The index of the first byte of the set in the text, or length if there is none.
+ */
+__attribute__((target("avx2")))
+inline size_t findAvx2(const unsigned char *text, size_t length, const ByteSet& set)
+{
+    const __m256i lowMask = _mm256_broadcastsi128_si256(
+        _mm_load_si128((const __m128i *) set.lowMask));
+    const __m256i highMask = _mm256_broadcastsi128_si256(
+        _mm_load_si128((const __m128i *) set.highMask));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for ( ; i + 32 <= length; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *) (text + i));
+        __m256i low = _mm256_shuffle_epi8(lowMask, _mm256_and_si256(bytes, nibble));
+        __m256i high = _mm256_shuffle_epi8(highMask,
+                                           _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+        uint32_t misses = (uint32_t) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_and_si256(low, high), zero));
+        // Skip the false candidates of the 32 bytes.
+        uint32_t candidates = ~misses;
+        while (candidates != 0)
+        {
+            size_t at = i + (size_t) __builtin_ctz(candidates);
+            if (set.contains[text[at]])
+            {
+                return at;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+    return i + findScalar(text + i, length - i, set);
+}
+
+#endif //EX3_X86
+
+/**
+ * The kernels of the CPU the program runs on, picked once at start-up.
+ */
+struct SimdKernels
+{
+    void (*normalize)(const char *, char *, size_t);
+    size_t (*find)(const unsigned char *, size_t, const ByteSet&);
+
+    /**
+     * Constructor. Picks the widest kernels the CPU supports.
+     */
+    SimdKernels() :
+        normalize(normalizeScalar),
+        find(findScalar)
+    {
+#ifdef EX3_X86
+        // SSE2 is part of every x86-64 CPU, but not of every 32 bit one.
+        if (__builtin_cpu_supports("sse2"))
+        {
+            normalize = normalizeSse2;
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            normalize = normalizeAvx2;
+            find = findAvx2;
+        }
+#endif
+    }
+
+    /**
+     * @return The kernels of the CPU.
+     */
+    static const SimdKernels& get()
+    {
+        static const SimdKernels kernels;
+        return kernels;
+    }
+};
+
+/**
+ * Normalize the given bytes of a message, like normalizeByte.
+ * @param in The bytes to normalize.
+ * @param out The buffer of the normalized bytes, that may be the same as in.
+ * @param length The number of bytes.
+ */
+inline void normalizeText(const char *in, char *out, size_t length)
+{
+    SimdKernels::get().normalize(in, out, length);
+}
+
+/**
+ * @param text The bytes to search.
+ * @param length The number of bytes.
+ * @param set The set of bytes to find.
+ * @return The index of the first byte of the set in the text, or length if there is none.
+ */
+inline size_t findByteOfSet(const unsigned char *text, size_t length, const ByteSet& set)
+{
+    return SimdKernels::get().find(text, length, set);
+}
+
+#endif //EX3_SIMD_HPP
@@ -0,0 +1,747 @@
+#ifndef EX3_SPAMDAEMON_HPP
+#define EX3_SPAMDAEMON_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "AhoCorasick.hpp"
+#include "HashMap.hpp"
+#include "MappedFile.hpp"
+#include "MessageScorer.hpp"
+
+/**
+ * Defines the request kind of a message that is sent in the request.
+ */
+const char REQUEST_MESSAGE = 'M';
+/**
+ * Defines the request kind of the path of a message file, in the messages directory of the daemon.
+ */
+const char REQUEST_PATH = 'P';
+/**
+ * Defines the size of a request header: its kind and the big-endian 32-bit length of its payload.
+ */
+const size_t REQUEST_HEADER = 5;
+/**
+ * Defines the size of a response header: the big-endian 32-bit length of its payload.
+ */
+const size_t RESPONSE_HEADER = 4;
+/**
+ * Defines the maximal payload of a request. A client that sends a larger one is disconnected. The
+ * daemon reads one request of a client at a time, so it's also about the most it buffers for one.
+ */
+const uint32_t MAX_REQUEST = 1u << 24;
+/**
+ * Defines the maximal number of events the daemon handles at once.
+ */
+const int MAX_EVENTS = 64;
+/**
+ * Defines the time in milliseconds between two checks of the database file.
+ */
+const int RELOAD_CHECK_MS = 1000;
+/**
+ * Defines the maximal number of bytes the daemon reads from a client at once.
+ */
+const size_t RECEIVE_BLOCK = 1 << 16;
+/**
+ * Defines the number of pending connections of the socket.
+ */
+const int LISTEN_BACKLOG = 128;
+/**
+ * Defines the verdict of a response to a spam message.
+ */
+const char* RESPONSE_SPAM = "SPAM";
+/**
+ * Defines the verdict of a response to a message that isn't spam.
+ */
+const char* RESPONSE_NOT_SPAM = "NOT_SPAM";
+/**
+ * Defines the response to an invalid request.
+ */
+const char* RESPONSE_INVALID = "-\tInvalid input";
+/**
+ * Defines the response to a request that ran out of memory.
+ */
+const char* RESPONSE_MEMORY = "-\tMemory allocation failed";
+/**
+ * Defines the separator of the directories of a path.
+ */
+const char PATH_SEPARATOR = '/';
+/**
+ * Defines a massage for a socket that couldn't be opened.
+ */
+const char* SOCKET_FAILED_MSG = "Failed to open the socket";
+/**
+ * Defines a massage for a messages directory that couldn't be found.
+ */
+const char* ROOT_FAILED_MSG = "Invalid massages directory";
+/**
+ * Defines the massage of a database that was reloaded.
+ */
+const char* RELOADED_MSG = "Reloaded the spam database";
+/**
+ * Defines the massage of a database that couldn't be reloaded.
+ */
+const char* RELOAD_FAILED_MSG = "Failed to reload the spam database, keeping the old one";
+
+/**
+ * Set when the daemon should stop, by SIGINT or SIGTERM.
+ */
+volatile std::sig_atomic_t daemonStopped = 0;
+
+/**
+ * Signal handler that stops the daemon.
+ */
+extern "C" inline void stopDaemon(int)
+{
+    daemonStopped = 1;
+}
+
+/**
+ * A daemon that scores messages for the clients of a Unix domain socket.
+ * A request is a kind byte (REQUEST_MESSAGE or REQUEST_PATH), the big-endian 32-bit length of its
+ * payload and the payload: the message itself or the path of a message file (only of a regular
+ * file in the messages directory the daemon was given, a relative path is relative to it, and
+ * without one every path is invalid). A client may send
+ * many requests on one connection, and gets a response for each of them in order: the big-endian
+ * 32-bit length of a "score<TAB>SPAM/NOT_SPAM" text, or "-<TAB>Invalid input". The daemon reads
+ * only one request of a client at a time, and doesn't read the next one until the response was
+ * sent, so a client that sends faster than it reads is held back by its socket instead of making
+ * the daemon buffer its requests.
+ * All the clients are served by one epoll event loop, that only reads the requests and sends the
+ * responses: the complete requests are queued for a fixed number of scoring threads, that wake the
+ * loop through an eventfd when their responses are ready, so a long message holds back only its own
+ * client and one scoring thread. The database is published through an atomic shared pointer: when
+ * its file changes, a background thread loads the new one and then swaps it in, while requests
+ * keep using the old one (which is freed by the last request that holds it).
+ * A database that changes while it's loaded isn't swapped in, and is loaded again at the next
+ * check, so a file that is rewritten in place is never used half written.
+ */
+class SpamDaemon
+{
+public:
+    /**
+     * A function that loads the database of a path, and throws an exception if it's invalid.
+     */
+    using Loader = std::function<std::shared_ptr<const AhoCorasick>(const std::string&)>;
+
+private:
+    /**
+     * A connected client, with the bytes of its next request that were read and the bytes of its
+     * response that weren't sent yet.
+     */
+    struct Client
+    {
+        // A number no other client of the daemon had, so a response is never sent to a client
+        // that got the socket of a client that disconnected.
+        uint64_t id = 0;
+        std::vector<char> input;
+        std::vector<char> output;
+        size_t sent = 0;
+        // True while the request of the client is being scored.
+        bool busy = false;
+    };
+
+    /**
+     * A request that is scored by a scoring thread, and its response.
+     */
+    struct Job
+    {
+        int fd;
+        uint64_t client;
+        std::vector<char> request;
+        std::string response;
+    };
+
+    std::string _socketPath;
+    std::string _databasePath;
+    int _threshold;
+    // The real path of the messages directory with a PATH_SEPARATOR at its end, or empty.
+    std::string _massageRoot;
+    Loader _loader;
+    std::shared_ptr<const AhoCorasick> _database;
+    int _listener;
+    int _epoll;
+    // The eventfd the scoring threads wake the event loop with.
+    int _wake;
+    HashMap<int, Client> _clients;
+    uint64_t _nextClient;
+    struct stat _databaseStat;
+    std::thread _reloader;
+    std::atomic<bool> _reloading;
+    std::vector<std::thread> _scorers;
+    // The jobs that wait for a scoring thread, in the order of their requests, and the finished
+    // ones.
+    std::mutex _jobsLock;
+    std::condition_variable _jobsReady;
+    std::deque<Job> _pending;
+    std::vector<Job> _finished;
+    bool _stopping;
+
+    /**
+     * @param info The state of a file.
+     * @param before An earlier state of the file.
+     * @return True if the file was replaced or written since the earlier state, false otherwise.
+     */
+    static bool _changed(const struct stat& info, const struct stat& before)
+    {
+        return info.st_dev != before.st_dev || info.st_ino != before.st_ino ||
+               info.st_size != before.st_size || info.st_mtim.tv_sec != before.st_mtim.tv_sec ||
+               info.st_mtim.tv_nsec != before.st_mtim.tv_nsec;
+    }
+
+    /**
+     * If the database file changed and no reload is running, load it again in the background.
+     */
+    void _checkReload()
+    {
+        struct stat info;
+        if (_reloading.load() || stat(_databasePath.c_str(), &info) != 0 ||
+            !_changed(info, _databaseStat))
+        {
+            return;
+        }
+        if (_reloader.joinable())
+        {
+            _reloader.join();
+        }
+        _databaseStat = info;
+        _reloading.store(true);
+        _reloader = std::thread([this, info]()
+        {
+            try
+            {
+                std::shared_ptr<const AhoCorasick> database = _loader(_databasePath);
+                struct stat loaded;
+                if (stat(_databasePath.c_str(), &loaded) != 0 || _changed(loaded, info))
+                {
+                    // The file was written while it was read, so load it again at the next check.
+                    std::memset(&_databaseStat, 0, sizeof(_databaseStat));
+                    _reloading.store(false);
+                    return;
+                }
+                std::atomic_store(&_database, database);
+                std::cerr << RELOADED_MSG << std::endl;
+            }
+            catch (const std::exception&)
+            {
+                std::cerr << RELOAD_FAILED_MSG << std::endl;
+            }
+            _reloading.store(false);
+        });
+    }
+
+    /**
+     * Open the listening socket and the epoll instance.
+     * @return True if they were opened, false otherwise.
+     */
+    bool _open()
+    {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        if (_socketPath.size() >= sizeof(address.sun_path))
+        {
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, _socketPath.c_str(), _socketPath.size() + 1);
+        _listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_listener < 0)
+        {
+            return false;
+        }
+        unlink(_socketPath.c_str());
+        if (bind(_listener, (const sockaddr *) &address, sizeof(address)) != 0 ||
+            listen(_listener, LISTEN_BACKLOG) != 0)
+        {
+            return false;
+        }
+        _epoll = epoll_create1(EPOLL_CLOEXEC);
+        _wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        return _epoll >= 0 && _wake >= 0 && _watch(_listener, EPOLLIN, EPOLL_CTL_ADD) &&
+               _watch(_wake, EPOLLIN, EPOLL_CTL_ADD);
+    }
+
+    /**
+     * Add a file descriptor to the epoll instance or change its events.
+     * @param fd The file descriptor.
+     * @param events The events to wait for.
+     * @param operation EPOLL_CTL_ADD or EPOLL_CTL_MOD.
+     * @return True if it succeeded, false otherwise.
+     */
+    bool _watch(int fd, uint32_t events, int operation)
+    {
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(_epoll, operation, fd, &event) == 0;
+    }
+
+    /**
+     * Accept all the pending clients.
+     */
+    void _accept()
+    {
+        while (true)
+        {
+            int fd = accept4(_listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                return;
+            }
+            if (!_watch(fd, EPOLLIN, EPOLL_CTL_ADD))
+            {
+                close(fd);
+                continue;
+            }
+            Client& client = _clients[fd];
+            client = Client();
+            client.id = _nextClient++;
+        }
+    }
+
+    /**
+     * Disconnect a client.
+     * @param fd The socket of the client.
+     */
+    void _disconnect(int fd)
+    {
+        epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        _clients.erase(fd);
+    }
+
+    /**
+     * @param data The first byte of a big-endian 32-bit number.
+     * @return The number.
+     */
+    static uint32_t _readLength(const char *data)
+    {
+        const unsigned char *bytes = (const unsigned char *) data;
+        return ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) |
+               ((uint32_t) bytes[2] << 8) | (uint32_t) bytes[3];
+    }
+
+    /**
+     * Resolve the path of a message file of a request.
+     * @param payload The path, absolute or relative to the messages directory.
+     * @param path Set to the real path of the file.
+     * @return True if the file is a regular file in the messages directory, false otherwise.
+     */
+    bool _resolve(std::string_view payload, std::string& path) const
+    {
+        if (_massageRoot.empty() || payload.empty())
+        {
+            return false;
+        }
+        std::string requested(payload);
+        if (requested[0] != PATH_SEPARATOR)
+        {
+            requested = _massageRoot + requested;
+        }
+        char resolved[PATH_MAX];
+        struct stat info;
+        if (realpath(requested.c_str(), resolved) == nullptr)
+        {
+            return false;
+        }
+        path = resolved;
+        return path.compare(0, _massageRoot.size(), _massageRoot) == 0 &&
+               stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+    }
+
+    /**
+     * Score a message with the given scorer and the threshold of the daemon.
+     * @param scorer The scorer, after the whole message was fed to it.
+     * @return The text of the response.
+     */
+    std::string _verdict(MessageScorer& scorer) const
+    {
+        int64_t score = scorer.finish();
+        const char *verdict = score >= _threshold ? RESPONSE_SPAM : RESPONSE_NOT_SPAM;
+        return std::to_string(score) + '\t' + verdict;
+    }
+
+    /**
+     * Answer a request with the current database. A message file is read in parts, so it takes
+     * constant memory and truncating it while it's read can't raise SIGBUS.
+     * @param request The request, with its header.
+     * @return The text of the response.
+     */
+    std::string _answer(const std::vector<char>& request) const
+    {
+        std::shared_ptr<const AhoCorasick> database = std::atomic_load(&_database);
+        MessageScorer scorer(*database);
+        std::string_view payload(request.data() + REQUEST_HEADER, request.size() - REQUEST_HEADER);
+        if (request[0] == REQUEST_MESSAGE)
+        {
+            scorer.feed(payload.data(), payload.size());
+            return _verdict(scorer);
+        }
+        std::string path;
+        if (request[0] != REQUEST_PATH || !_resolve(payload, path))
+        {
+            return RESPONSE_INVALID;
+        }
+        MappedFile massageFile(path.c_str(), ACCESS_READ);
+        bool read = massageFile && massageFile.forEachPart([&scorer](std::string_view part)
+                                                           {
+                                                               scorer.feed(part.data(),
+                                                                           part.size());
+                                                               return true;
+                                                           });
+        return read ? _verdict(scorer) : RESPONSE_INVALID;
+    }
+
+    /**
+     * The loop of a scoring thread, that answers the pending requests one at a time until the
+     * daemon is destroyed.
+     */
+    void _scoreLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> guard(_jobsLock);
+                _jobsReady.wait(guard, [this] { return _stopping || !_pending.empty(); });
+                if (_stopping)
+                {
+                    return;
+                }
+                job = std::move(_pending.front());
+                _pending.pop_front();
+            }
+            try
+            {
+                job.response = _answer(job.request);
+            }
+            catch (const std::bad_alloc&)
+            {
+                job.response = RESPONSE_MEMORY;
+            }
+            job.request = std::vector<char>();
+            {
+                std::lock_guard<std::mutex> guard(_jobsLock);
+                _finished.push_back(std::move(job));
+            }
+            uint64_t one = 1;
+            ssize_t written = write(_wake, &one, sizeof(one));
+            (void) written;
+        }
+    }
+
+    /**
+     * Append a response to the output of a client.
+     * @param response The text of the response.
+     * @param output The output of the client.
+     */
+    static void _respond(const std::string& response, std::vector<char>& output)
+    {
+        uint32_t length = (uint32_t) response.size();
+        char header[RESPONSE_HEADER] = {(char) (length >> 24), (char) (length >> 16),
+                                        (char) (length >> 8), (char) length};
+        output.insert(output.end(), header, header + RESPONSE_HEADER);
+        output.insert(output.end(), response.begin(), response.end());
+    }
+
+    /**
+     * Send the responses the scoring threads finished to their clients, if they're still
+     * connected, and read the clients again once their responses were sent.
+     */
+    void _deliver()
+    {
+        uint64_t count;
+        ssize_t read = ::read(_wake, &count, sizeof(count));
+        (void) read;
+        std::vector<Job> finished;
+        {
+            std::lock_guard<std::mutex> guard(_jobsLock);
+            finished.swap(_finished);
+        }
+        for (const Job& job : finished)
+        {
+            auto found = _clients.find(job.fd);
+            if (found == _clients.end() || found->second.id != job.client)
+            {
+                continue;
+            }
+            Client& client = found->second;
+            client.busy = false;
+            _respond(job.response, client.output);
+            if (!_flush(job.fd, client))
+            {
+                _disconnect(job.fd);
+                continue;
+            }
+            _watch(job.fd, client.output.empty() ? EPOLLIN : EPOLLOUT, EPOLL_CTL_MOD);
+        }
+    }
+
+    /**
+     * Send as much as possible of the pending responses of a client.
+     * @param fd The socket of the client.
+     * @param client The client.
+     * @return False if the client should be disconnected, true otherwise.
+     */
+    bool _flush(int fd, Client& client)
+    {
+        while (client.sent < client.output.size())
+        {
+            ssize_t count = send(fd, client.output.data() + client.sent,
+                                 client.output.size() - client.sent, MSG_NOSIGNAL);
+            if (count < 0)
+            {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            client.sent += (size_t) count;
+        }
+        client.output.clear();
+        client.sent = 0;
+        return true;
+    }
+
+    /**
+     * @param client A client.
+     * @return The number of bytes of the next request of the client with its header, or 0 if its
+     * header wasn't read yet.
+     */
+    static size_t _requestSize(const Client& client)
+    {
+        if (client.input.size() < REQUEST_HEADER)
+        {
+            return 0;
+        }
+        return REQUEST_HEADER + _readLength(client.input.data() + 1);
+    }
+
+    /**
+     * Read the next request of a client, and nothing after it.
+     * @param fd The socket of the client.
+     * @param client The client.
+     * @return False if the client closed its socket or failed, true otherwise.
+     */
+    static bool _read(int fd, Client& client)
+    {
+        while (true)
+        {
+            size_t size = _requestSize(client);
+            size_t used = client.input.size();
+            size_t missing = (size == 0 ? REQUEST_HEADER : size) - used;
+            if (missing == 0 || size > REQUEST_HEADER + MAX_REQUEST)
+            {
+                return true;
+            }
+            client.input.resize(used + std::min(missing, RECEIVE_BLOCK));
+            ssize_t count = recv(fd, client.input.data() + used, client.input.size() - used, 0);
+            client.input.resize(used + (count > 0 ? (size_t) count : 0));
+            if (count > 0 || (count < 0 && errno == EINTR))
+            {
+                continue;
+            }
+            return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+
+    /**
+     * Read the next request of a client, and if it's complete queue it for the scoring threads. The
+     * client isn't read again until its response was sent.
+     * @param fd The socket of the client.
+     */
+    void _receive(int fd)
+    {
+        Client& client = _clients[fd];
+        bool open = _read(fd, client);
+        size_t size = _requestSize(client);
+        if (size > REQUEST_HEADER + MAX_REQUEST)
+        {
+            _disconnect(fd);
+            return;
+        }
+        if (size != 0 && client.input.size() == size)
+        {
+            {
+                std::lock_guard<std::mutex> guard(_jobsLock);
+                _pending.push_back(Job{fd, client.id, std::move(client.input), std::string()});
+            }
+            _jobsReady.notify_one();
+            client.input.clear();
+            client.busy = true;
+            _watch(fd, 0, EPOLL_CTL_MOD);
+            return;
+        }
+        if (!open)
+        {
+            _disconnect(fd);
+        }
+    }
+
+public:
+
+    /**
+     * Constructor. Loads the database, and throws an exception if it or the messages directory is
+     * invalid.
+     * @param socketPath The path of the Unix domain socket.
+     * @param databasePath The path of the database, that is reloaded when it changes.
+     * @param threshold The threshold of a spam message.
+     * @param loader The function that loads the database.
+     * @param threads The number of threads that score the messages (at least one is started).
+     * @param massageRoot The directory of the message files of the requests, or empty to refuse
+     * them.
+     */
+    SpamDaemon(std::string socketPath, std::string databasePath, int threshold, Loader loader,
+               int threads, const std::string& massageRoot) :
+        _socketPath(std::move(socketPath)),
+        _databasePath(std::move(databasePath)),
+        _threshold(threshold),
+        _loader(std::move(loader)),
+        _listener(-1),
+        _epoll(-1),
+        _wake(-1),
+        _nextClient(0),
+        _reloading(false),
+        _stopping(false)
+    {
+        if (!massageRoot.empty())
+        {
+            char resolved[PATH_MAX];
+            struct stat info;
+            if (realpath(massageRoot.c_str(), resolved) == nullptr ||
+                stat(resolved, &info) != 0 || !S_ISDIR(info.st_mode))
+            {
+                throw std::invalid_argument(ROOT_FAILED_MSG);
+            }
+            _massageRoot = resolved;
+            if (_massageRoot.back() != PATH_SEPARATOR)
+            {
+                _massageRoot += PATH_SEPARATOR;
+            }
+        }
+        std::memset(&_databaseStat, 0, sizeof(_databaseStat));
+        stat(_databasePath.c_str(), &_databaseStat);
+        _database = _loader(_databasePath);
+        for (int i = 0; i < std::max(threads, 1); i++)
+        {
+            _scorers.emplace_back(&SpamDaemon::_scoreLoop, this);
+        }
+    }
+
+    SpamDaemon(const SpamDaemon&) = delete;
+
+    SpamDaemon& operator=(const SpamDaemon&) = delete;
+
+    /**
+     * Destructor. Stops the scoring threads, waits for a running reload and closes all the sockets.
+     */
+    ~SpamDaemon()
+    {
+        {
+            std::lock_guard<std::mutex> guard(_jobsLock);
+            _stopping = true;
+        }
+        _jobsReady.notify_all();
+        for (std::thread& scorer : _scorers)
+        {
+            scorer.join();
+        }
+        if (_reloader.joinable())
+        {
+            _reloader.join();
+        }
+        for (const auto& client : _clients)
+        {
+            close(client.first);
+        }
+        if (_wake >= 0)
+        {
+            close(_wake);
+        }
+        if (_epoll >= 0)
+        {
+            close(_epoll);
+        }
+        if (_listener >= 0)
+        {
+            close(_listener);
+            unlink(_socketPath.c_str());
+        }
+    }
+
+    /**
+     * Serve the clients until SIGINT or SIGTERM.
+     * @return EXIT_SUCCESS if the daemon stopped by a signal, EXIT_FAILURE if it couldn't start.
+     */
+    int run()
+    {
+        if (!_open())
+        {
+            std::cerr << SOCKET_FAILED_MSG << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::signal(SIGINT, stopDaemon);
+        std::signal(SIGTERM, stopDaemon);
+        epoll_event events[MAX_EVENTS];
+        while (!daemonStopped)
+        {
+            int count = epoll_wait(_epoll, events, MAX_EVENTS, RELOAD_CHECK_MS);
+            for (int i = 0; i < count; i++)
+            {
+                int fd = events[i].data.fd;
+                if (fd == _listener)
+                {
+                    _accept();
+                }
+                else if (fd == _wake)
+                {
+                    _deliver();
+                }
+                else if (!_clients.containsKey(fd))
+                {
+                    continue;
+                }
+                else if (_clients[fd].busy)
+                {
+                    // A busy client is only woken by a hang-up or an error.
+                    _disconnect(fd);
+                }
+                else if (_clients[fd].output.empty())
+                {
+                    _receive(fd);
+                }
+                else if (!_flush(fd, _clients[fd]))
+                {
+                    _disconnect(fd);
+                }
+                else if (_clients[fd].output.empty())
+                {
+                    _watch(fd, EPOLLIN, EPOLL_CTL_MOD);
+                }
+            }
+            _checkReload();
+        }
+        return EXIT_SUCCESS;
+    }
+
+};
+
+#endif //EX3_SPAMDAEMON_HPP
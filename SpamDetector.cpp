@@ -1,6 +1,18 @@
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <charconv>
+#include <cctype>
+#include <sstream>
 #include "HashMap.hpp"
+#include "AhoCorasick.hpp"
+#include "MessageScorer.hpp"
+#include "MatchReport.hpp"
+#include "WordMatcher.hpp"
+#include "MappedFile.hpp"
+#include "WorkStealingPool.hpp"
+#include "SpamDaemon.hpp"
 
 /**
  * Defines the expected arguments amount.
@@ -9,7 +21,13 @@ const int ARGS_AMOUNT = 4;
 /**
  * Defines the program usage massage.
  */
-const char* USAGE_MSG = "Usage: SpamDetector <database path> <message path> <threshold>";
+const char* USAGE_MSG = "Usage: SpamDetector [-e report path | -w] <database path> <message path> "
+                        "<threshold>\n"
+                        "       SpamDetector -b [-j threads] [-w | [-e report path] [-s]] "
+                        "<database path> <directory|list file|-> <threshold>\n"
+                        "       SpamDetector --compile <database path> <compiled database path>\n"
+                        "       SpamDetector -d [-j threads] [-r massages directory] "
+                        "<database path> <socket path> <threshold>";
 /**
  * Define invalid input massage.
  */
@@ -42,121 +60,900 @@ const char* SPAM_MSG = "SPAM";
  * Define the not-spam massage to print.
  */
 const char* NOT_SPAM_MSG = "NOT_SPAM";
+/**
+ * Defines the flag of the batch mode.
+ */
+const std::string BATCH_FLAG = "-b";
+/**
+ * Defines the massages argument of the batch mode that reads the massage paths from stdin.
+ */
+const std::string STDIN_ARG = "-";
+/**
+ * Defines the separator of the columns of the batch mode output.
+ */
+const char COLUMN_SEPARATOR = '\t';
+/**
+ * Defines the flag of the number of threads of the batch mode.
+ */
+const std::string THREADS_FLAG = "-j";
+/**
+ * Defines the number of massages of a batch that are scored together before their lines are
+ * printed.
+ */
+const size_t BATCH_WINDOW = 4096;
+/**
+ * Defines the number of threads argument that means a thread for every core.
+ */
+const std::string ALL_CORES_ARG = "0";
+/**
+ * Defines the flag of the explain mode, that writes a report of the phrases of every massage.
+ */
+const std::string REPORT_FLAG = "-e";
+/**
+ * Defines the extension of a report path that is written as JSON (any other one is written as
+ * TSV).
+ */
+const std::string JSON_EXTENSION = ".json";
+/**
+ * Defines the massage of a report file that couldn't be opened.
+ */
+const char* REPORT_FAILED_MSG = "Failed to open the report file";
+/**
+ * Defines the flag of the batch mode that prints how much of the batch the prefilter of the
+ * automaton rejected.
+ */
+const std::string STATS_FLAG = "-s";
+/**
+ * Defines the start of the prefilter statistics massage, before the number of rejected massages.
+ */
+const char* STATS_MSG = "Prefilter: rejected ";
+/**
+ * Defines the parts of the prefilter statistics massage between its numbers.
+ */
+const char* STATS_OF_MSG = " of ";
+const char* STATS_MASSAGES_MSG = " massages (";
+const char* STATS_SKIPPED_MSG = "%), skipped ";
+const char* STATS_BYTES_MSG = " bytes (";
+const char* STATS_END_MSG = "%)";
+/**
+ * Defines the factor of a part to a percentage.
+ */
+const double PERCENT = 100;
+/**
+ * Defines the flag of the whole word mode, that matches the phrases only to whole words of the
+ * massages.
+ */
+const std::string WORDS_FLAG = "-w";
+/**
+ * Defines the flag of the daemon mode.
+ */
+const std::string DAEMON_FLAG = "-d";
+/**
+ * Defines the flag of the daemon mode that lets the clients send paths of the massage files of a
+ * directory.
+ */
+const std::string ROOT_FLAG = "-r";
+/**
+ * Defines the index of the socket path argument of the daemon mode.
+ */
+const int SOCKET_ARG = 2;
+/**
+ * Defines the flag that compiles a spam file to a compiled spam database. It starts with "--" so it
+ * can't be taken for the database path of the single mode.
+ */
+const std::string COMPILE_FLAG = "--compile";
+/**
+ * Defines the index of the spam file path argument of the compile flag.
+ */
+const int COMPILE_SPAM_ARG = 2;
+/**
+ * Defines the index of the compiled spam database path argument of the compile flag.
+ */
+const int COMPILE_IMAGE_ARG = 3;
+/**
+ * Defines the suffix of the temporary file a compiled spam database is written to, before it
+ * replaces the old one.
+ */
+const std::string TEMP_SUFFIX = ".tmp";
+/**
+ * Defines the massage of a compiled spam database that couldn't be written.
+ */
+const char* WRITE_FAILED_MSG = "Failed to write the compiled database";
+/**
+ * Defines the line of an invalid spam file line in the invalid input massage.
+ */
+const char* LINE_MSG = " (line ";
+/**
+ * Defines the smallest spam file that is parsed by several threads.
+ */
+const size_t PARALLEL_PARSE_SIZE = 8 << 20;
+/**
+ * Defines the number of bytes of a spam file that a thread parses at least.
+ */
+const size_t PARSE_CHUNK_SIZE = 4 << 20;
 
 /**
- * Parse the spam file and put the phrase with there score into the given HashMap. If the file is
- * invalid, it will throw an exception.
- * @param spamFile File to parse.
+ * Parse a line of the spam file, without allocating or throwing. The score is parsed like
+ * std::stoi: it may start with white spaces and a sign, and must have nothing after its digits.
+ * @param line The line, without its end.
+ * @param phrase Set to the phrase.
+ * @param score Set to the score.
+ * @return True if the line is valid, false otherwise.
+ */
+bool parseSpamLine(std::string_view line, std::string_view& phrase, int& score)
+{
+    size_t i = line.find(SEPARATOR);
+    if (i == std::string_view::npos)
+    {
+        return false;
+    }
+    phrase = line.substr(0, i);
+    const char *first = line.data() + i + 1, *last = line.data() + line.size();
+    while (first != last && std::isspace((unsigned char) *first))
+    {
+        first++;
+    }
+    if (first != last && *first == '+' && last - first > 1 &&
+        std::isdigit((unsigned char) first[1]))
+    {
+        first++;
+    }
+    std::from_chars_result result = std::from_chars(first, last, score);
+    return result.ec == std::errc() && result.ptr == last;
+}
+
+/**
+ * Parse the lines of a part of the spam file, that starts at the start of a line.
+ * @param text The part of the spam file.
+ * @param insert A function that gets the phrase and the score of every line.
+ * @param lines Set to the number of lines of the part.
+ * @return 0 if all the lines are valid, or the number of the first invalid line of the part.
+ */
+template <typename F>
+size_t parseSpamLines(std::string_view text, F insert, size_t& lines)
+{
+    lines = 0;
+    while (!text.empty())
+    {
+        size_t lineEnd = text.find(NEW_LINE);
+        std::string_view line = text.substr(0, lineEnd);
+        text.remove_prefix(lineEnd == std::string_view::npos ? text.size() : lineEnd + 1);
+        lines++;
+        std::string_view phrase;
+        int score;
+        if (!parseSpamLine(line, phrase, score))
+        {
+            return lines;
+        }
+        insert(phrase, score);
+    }
+    return 0;
+}
+
+/**
+ * Split the spam file to the given number of parts, at the starts of lines.
+ * @param spamFile The contents of the spam file.
+ * @param parts The number of parts.
+ * @return The parts, in the order of the file.
+ */
+std::vector<std::string_view> splitSpamFile(std::string_view spamFile, size_t parts)
+{
+    std::vector<std::string_view> result;
+    size_t start = 0;
+    for (size_t i = 1; i <= parts && start < spamFile.size(); i++)
+    {
+        size_t end = i == parts ? spamFile.size() : std::max(start, spamFile.size() * i / parts);
+        end = end >= spamFile.size() ? spamFile.size() : spamFile.find(NEW_LINE, end);
+        end = end == std::string_view::npos ? spamFile.size() : end + 1;
+        result.push_back(spamFile.substr(start, end - start));
+        start = end;
+    }
+    return result;
+}
+
+/**
+ * Parse the spam file and put the phrase with there score into the given HashMap. If a phrase
+ * appears more than once, its first score is kept. The phrases are views of the spam file. A large
+ * file is split to parts that are parsed by several threads, and then merged in order.
+ * @param spamFile The contents of the file to parse.
+ * @param spamMap The HashMap to insert all the phrases and their score.
+ * @return 0 if the file is valid, or the number of its first invalid line.
+ */
+size_t parseSpamFile(std::string_view spamFile, HashMap<std::string_view, int>& spamMap)
+{
+    spamMap.reserve((int) std::count(spamFile.begin(), spamFile.end(), NEW_LINE) + 1);
+    auto insert = [&spamMap](std::string_view phrase, int score)
+    {
+        spamMap.try_emplace(phrase, score);
+    };
+    size_t threads = std::min((size_t) std::max(1u, std::thread::hardware_concurrency()),
+                              spamFile.size() / PARSE_CHUNK_SIZE);
+    size_t lines;
+    if (spamFile.size() < PARALLEL_PARSE_SIZE || threads <= 1)
+    {
+        return parseSpamLines(spamFile, insert, lines);
+    }
+    std::vector<std::string_view> parts = splitSpamFile(spamFile, threads);
+    std::vector<std::vector<std::pair<std::string_view, int>>> parsed(parts.size());
+    std::vector<size_t> partLines(parts.size()), errors(parts.size());
+    WorkStealingPool pool((int) threads);
+    pool.run(parts.size(), [&](size_t part, int)
+    {
+        auto add = [&parsed, part](std::string_view phrase, int score)
+        {
+            parsed[part].emplace_back(phrase, score);
+        };
+        parsed[part].reserve(std::count(parts[part].begin(), parts[part].end(), NEW_LINE) + 1);
+        errors[part] = parseSpamLines(parts[part], add, partLines[part]);
+    });
+    size_t firstLine = 0;
+    for (size_t part = 0; part < parts.size(); part++)
+    {
+        if (errors[part] != 0)
+        {
+            return firstLine + errors[part];
+        }
+        for (const auto& entry : parsed[part])
+        {
+            insert(entry.first, entry.second);
+        }
+        firstLine += partLines[part];
+    }
+    return 0;
+}
+
+/**
+ * The file the reports of the explain mode are written to.
+ */
+struct ReportSink
+{
+    std::ofstream file;
+    ReportFormat format;
+};
+
+/**
+ * Score the whole massage file with the given scorer, one part at a time.
+ * @param scorer A MessageScorer or a WordScorer.
+ * @param massageFile The massage file.
+ * @param score Set to the score of the massage.
+ * @return True if the whole massage file was read, false otherwise.
+ */
+template <typename Scorer>
+bool scoreMassage(Scorer& scorer, MappedFile& massageFile, int64_t& score)
+{
+    scorer.reset();
+    bool read = massageFile.forEachPart([&scorer](std::string_view part)
+                                        {
+                                            scorer.feed(part.data(), part.size());
+                                            return true;
+                                        });
+    score = scorer.finish();
+    return read;
+}
+
+/**
+ * Score the whole massage file like scoreMassage. If it can't be read, it will throw an exception.
+ * @param scorer A MessageScorer or a WordScorer.
+ * @param massageFile The massage file.
+ * @return The score of the massage.
+ */
+template <typename Scorer>
+int64_t scoreValidMassage(Scorer& scorer, MappedFile& massageFile)
+{
+    int64_t score;
+    if (!scoreMassage(scorer, massageFile, score))
+    {
+        throw std::invalid_argument(INVALID_INPUT_MSG);
+    }
+    return score;
+}
+
+/**
+ * Check if the score of the massage, by the number of times every phrase appears in it, reaches the
+ * threshold. The massage is scanned only until the answer is known: a streamed massage, whose
+ * length isn't known, is read only until its score reaches the threshold.
+ * @param massageFile the massage file.
+ * @param matcher the automaton of all the spam phrases.
+ * @param threshold The threshold of a spam massage.
+ * @return true if the massage is spam, false otherwise.
+ */
+bool checkSpam(MappedFile& massageFile, const AhoCorasick& matcher, int threshold)
+{
+    MessageScorer scorer(matcher);
+    if (!massageFile.streamed())
+    {
+        return scorer.isSpam(massageFile.view(), threshold);
+    }
+    scorer.reset();
+    bool read = massageFile.forEachPart([&scorer, threshold](std::string_view part)
+                                        {
+                                            scorer.feed(part.data(), part.size());
+                                            return !scorer.reached(threshold);
+                                        });
+    if (!read)
+    {
+        throw std::invalid_argument(INVALID_INPUT_MSG);
+    }
+    return scorer.reached(threshold) || scorer.finish() >= threshold;
+}
+
+/**
+ * Check if the score of the massage, by the number of times every phrase appears in it as whole
+ * words, reaches the threshold.
+ * @param massageFile the massage file.
+ * @param words the index of all the spam phrases.
+ * @param threshold The threshold of a spam massage.
+ * @return true if the massage is spam, false otherwise.
+ */
+bool checkWords(MappedFile& massageFile, const WordMatcher& words, int threshold)
+{
+    WordScorer scorer(words);
+    return scoreValidMassage(scorer, massageFile) >= threshold;
+}
+
+/**
+ * Check if the score of the massage reaches the threshold like checkSpam, and write the report of
+ * the phrases that were found in it. The whole massage is scanned.
+ * @param massageFile the massage file.
+ * @param name The name of the massage in the report.
+ * @param matcher the automaton of all the spam phrases.
+ * @param threshold The threshold of a spam massage.
+ * @param sink The file to write the report to.
+ * @return true if the massage is spam, false otherwise.
+ */
+bool explainSpam(MappedFile& massageFile, const std::string& name, const AhoCorasick& matcher,
+                 int threshold, ReportSink& sink)
+{
+    MatchReport report(matcher);
+    MessageScorer scorer(matcher);
+    scorer.setReport(&report);
+    int64_t score = scoreValidMassage(scorer, massageFile);
+    bool spam = score >= threshold;
+    report.write(sink.file, sink.format, name, score, spam ? SPAM_MSG : NOT_SPAM_MSG);
+    return spam;
+}
+
+/**
+ * Parse the spam file like parseSpamFile. If the file is invalid, it will throw an exception with
+ * the number of its first invalid line.
+ * @param spamFile The contents of the file to parse.
  * @param spamMap The HashMap to insert all the phrases and their score.
  */
-void parseSpamFile(std::ifstream& spamFile, HashMap<std::string, int>& spamMap)
+void parseValidSpamFile(std::string_view spamFile, HashMap<std::string_view, int>& spamMap)
+{
+    size_t invalidLine = parseSpamFile(spamFile, spamMap);
+    if (invalidLine != 0)
+    {
+        throw std::invalid_argument(std::string(INVALID_INPUT_MSG) + LINE_MSG +
+                                    std::to_string(invalidLine) + ")");
+    }
+}
+
+/**
+ * Load the spam database of the given file: a compiled spam database is used in place, and a spam
+ * file is parsed and its automaton is built. If the file is invalid, it will throw an exception.
+ * @param spamFile The spam file or the compiled spam database.
+ * @return The automaton of all the spam phrases.
+ */
+AhoCorasick loadDatabase(MappedFile&& spamFile)
+{
+    if (AhoCorasick::isImage(spamFile.view()))
+    {
+        return AhoCorasick::open(std::move(spamFile));
+    }
+    HashMap<std::string_view, int> spamMap;
+    parseValidSpamFile(spamFile.view(), spamMap);
+    return AhoCorasick(spamMap);
+}
+
+/**
+ * Load the spam database of the given file for the whole word mode: the index is built from the
+ * phrases of a compiled spam database, or of a parsed spam file (without building its automaton).
+ * If the file is invalid, it will throw an exception.
+ * @param spamFile The spam file or the compiled spam database.
+ * @return The index of all the spam phrases.
+ */
+WordMatcher loadWords(MappedFile&& spamFile)
+{
+    if (AhoCorasick::isImage(spamFile.view()))
+    {
+        return WordMatcher(AhoCorasick::open(std::move(spamFile)));
+    }
+    HashMap<std::string_view, int> spamMap;
+    parseValidSpamFile(spamFile.view(), spamMap);
+    return WordMatcher(spamMap);
+}
+
+/**
+ * Load the spam database of the given path for the daemon. The file is copied rather than mapped,
+ * so the daemon keeps its database even if the file is rewritten in place. If the file is invalid,
+ * it will throw an exception.
+ * @param path The path of the spam file or the compiled spam database.
+ * @return The automaton of all the spam phrases.
+ */
+std::shared_ptr<const AhoCorasick> loadSharedDatabase(const std::string& path)
+{
+    MappedFile spamFile(path.c_str(), ACCESS_COPY);
+    if (!spamFile)
+    {
+        throw std::invalid_argument(INVALID_INPUT_MSG);
+    }
+    return std::make_shared<const AhoCorasick>(loadDatabase(std::move(spamFile)));
+}
+
+/**
+ * Map the massage file of the given path, or open it to be streamed if it can't be mapped (like a
+ * pipe). If it can't be opened, it will throw an exception.
+ * @param path The path of the massage file.
+ * @return The massage file.
+ */
+MappedFile openMassage(const char *path)
 {
-    std::string line, phrase, strScore;
-    int score;
-    while (getline(spamFile, line))
+    MappedFile massageFile(path, ACCESS_STREAM);
+    if (!massageFile)
+    {
+        throw std::invalid_argument(INVALID_INPUT_MSG);
+    }
+    return massageFile;
+}
+
+/**
+ * Compile a spam file to a compiled spam database, that replaces the output file at once.
+ * @param spamPath The path of the spam file.
+ * @param imagePath The path of the compiled spam database.
+ * @return EXIT_SUCCESS if the database was compiled, EXIT_FAILURE otherwise.
+ */
+int runCompile(const std::string& spamPath, const std::string& imagePath)
+{
+    MappedFile spamFile(spamPath.c_str());
+    if (!spamFile)
+    {
+        std::cerr << INVALID_INPUT_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+    try
     {
-        int i = 0;
-        for ( ; i < (int) line.length(); i++)
+        AhoCorasick matcher = loadDatabase(std::move(spamFile));
+        std::string tempPath = imagePath + TEMP_SUFFIX;
+        std::ofstream imageFile(tempPath, std::ios::binary | std::ios::trunc);
+        bool written = imageFile && matcher.save(imageFile);
+        imageFile.close();
+        if (!written || !imageFile || std::rename(tempPath.c_str(), imagePath.c_str()) != 0)
         {
-            if (line[i] == SEPARATOR)
+            std::remove(tempPath.c_str());
+            std::cerr << WRITE_FAILED_MSG << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        std::cerr << MEMORY_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Parse an argument of a positive number, like the threshold.
+ * @param arg The argument.
+ * @param value Set to the number.
+ * @return True if the argument is a valid positive number, false otherwise.
+ */
+bool parsePositive(const std::string& arg, int& value)
+{
+    try
+    {
+        size_t end;
+        value = std::stoi(arg, &end);
+        return end == arg.length() && value > 0;
+    }
+    catch (const std::logic_error&)
+    {
+        return false;
+    }
+}
+
+/**
+ * Parse the number of threads argument, where 0 means a thread for every core.
+ * @param arg The argument.
+ * @param threads Set to the number of threads.
+ * @return True if the argument is a valid number of threads, false otherwise.
+ */
+bool parseThreads(const std::string& arg, int& threads)
+{
+    if (arg == ALL_CORES_ARG)
+    {
+        threads = (int) std::max(1u, std::thread::hardware_concurrency());
+        return true;
+    }
+    return parsePositive(arg, threads);
+}
+
+/**
+ * Call the given function with the path of every massage of a batch.
+ * @param source A directory of massage files (taken in the order of their names), a file with a
+ * massage path in every line, or STDIN_ARG to read the massage paths from the standard input.
+ * @param func A function that gets a massage path.
+ * @return True if the massages source could be read, false otherwise.
+ */
+template <typename F>
+bool forEachMassage(const std::string& source, F func)
+{
+    if (source == STDIN_ARG)
+    {
+        std::string path;
+        while (getline(std::cin, path))
+        {
+            if (!path.empty())
             {
-                break;
+                func(path);
             }
         }
-        phrase = line.substr(0, i);
-        strScore = line.substr(i + 1, line.length() - i - 1);
-        size_t end;
-        score = std::stoi(line.substr(i + 1, line.length() - i - 1), &end);
-        if (end != strScore.length())
+        return true;
+    }
+    std::error_code error;
+    if (std::filesystem::is_directory(source, error))
+    {
+        std::vector<std::string> paths;
+        for (const auto& entry : std::filesystem::directory_iterator(source, error))
+        {
+            if (entry.is_regular_file(error))
+            {
+                paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+        for (const std::string& path : paths)
+        {
+            func(path);
+        }
+        return !error;
+    }
+    MappedFile listFile(source.c_str());
+    if (!listFile)
+    {
+        return false;
+    }
+    std::string_view list = listFile.view();
+    while (!list.empty())
+    {
+        size_t lineEnd = list.find(NEW_LINE);
+        std::string_view path = list.substr(0, lineEnd);
+        list.remove_prefix(lineEnd == std::string_view::npos ? list.size() : lineEnd + 1);
+        if (!path.empty())
         {
-            throw std::invalid_argument(INVALID_INPUT_MSG);
+            func(std::string(path));
         }
-        spamMap.insert(phrase, score);
     }
+    return true;
 }
 
 /**
- * Change the given text string to lower cases.
- * @param text String to change.
+ * Score a window of massages of a batch on the workers of the pool, and print a line of its path,
+ * its score and its spam massage for each of them, in the order of the window.
+ * @param paths The paths of the massages of the window.
+ * @param score A function that gets the worker, a massage file and the score to set, and returns
+ * true if the whole massage was read (like scoreMassage).
+ * @param reports A report for every worker of the pool, used by its scorer if there is a sink.
+ * @param pool The pool that scores the massages.
+ * @param threshold The threshold of a spam massage.
+ * @param sink The file to write the reports of the massages to, or nullptr.
+ * @return True if all the massages were scored, false otherwise (a massage that couldn't be read
+ * or that ran out of memory gets a line of its error in the standard error).
  */
-void toLower(std::string& text)
+template <typename F>
+bool scoreWindow(const std::vector<std::string>& paths, F score,
+                 std::vector<std::unique_ptr<MatchReport>>& reports, WorkStealingPool& pool,
+                 int threshold, ReportSink *sink)
 {
-    for (unsigned long i = 0; i < text.length(); i++)
+    std::vector<int64_t> scores(paths.size());
+    // The error of every massage, or nullptr if it was scored.
+    std::vector<const char*> errors(paths.size(), INVALID_INPUT_MSG);
+    std::vector<std::string> reportTexts(sink != nullptr ? paths.size() : 0);
+    pool.run(paths.size(), [&](size_t task, int worker)
     {
-        text[i] = tolower(text[i]);
+        try
+        {
+            MappedFile massageFile(paths[task].c_str(), ACCESS_STREAM);
+            if (massageFile && score(worker, massageFile, scores[task]))
+            {
+                if (sink != nullptr)
+                {
+                    std::ostringstream text;
+                    reports[worker]->write(text, sink->format, paths[task], scores[task],
+                                           scores[task] >= threshold ? SPAM_MSG : NOT_SPAM_MSG);
+                    reportTexts[task] = text.str();
+                }
+                errors[task] = nullptr;
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            errors[task] = MEMORY_MSG;
+        }
+    });
+    bool scored = true;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        if (errors[i] != nullptr)
+        {
+            std::cerr << paths[i] << COLUMN_SEPARATOR << errors[i] << '\n';
+            scored = false;
+            continue;
+        }
+        std::cout << paths[i] << COLUMN_SEPARATOR << scores[i] << COLUMN_SEPARATOR
+                  << (scores[i] >= threshold ? SPAM_MSG : NOT_SPAM_MSG) << '\n';
+        if (sink != nullptr)
+        {
+            sink->file << reportTexts[i];
+        }
     }
+    return scored;
 }
 
 /**
- * Check for every phrase how many times it appears in the massage, and calculate the score of this
- * massage.
- * @param massageFile the massage text file.
- * @param spamMap the spam map that contains all the spam phrases.
- * @return the score of this massage.
+ * Score every massage of a batch with the same automaton (or index of whole words), and print a
+ * line of its path, its score and its spam massage for each of them, in the order of the batch.
+ * @param source The massages of the batch, as forEachMassage gets them.
+ * @param matcher the automaton of all the spam phrases, or nullptr if words isn't.
+ * @param threshold The threshold of a spam massage.
+ * @param threads The number of threads that score the massages.
+ * @param sink The file to write the reports of the massages to, or nullptr.
+ * @param stats Whether to print the statistics of the prefilter to stderr at the end.
+ * @param words The index of all the spam phrases to score the massages by whole words with, or
+ * nullptr to score them by the automaton.
+ * @return EXIT_SUCCESS if all the massages were scored, EXIT_FAILURE otherwise.
  */
-int checkSpam(std::ifstream& massageFile, const HashMap<std::string, int>& spamMap)
+int runBatch(const std::string& source, const AhoCorasick *matcher, int threshold, int threads,
+             ReportSink *sink, bool stats, const WordMatcher *words)
 {
-    std::string text, line;
-    while (getline(massageFile, line))
+    std::ios::sync_with_stdio(false);
+    WorkStealingPool pool(threads);
+    std::vector<std::unique_ptr<MessageScorer>> scorers;
+    std::vector<std::unique_ptr<WordScorer>> wordScorers;
+    std::vector<std::unique_ptr<MatchReport>> reports;
+    for (int i = 0; i < threads; i++)
     {
-        text += line + " ";
+        if (words != nullptr)
+        {
+            wordScorers.emplace_back(new WordScorer(*words));
+            continue;
+        }
+        scorers.emplace_back(new MessageScorer(*matcher));
+        if (sink != nullptr)
+        {
+            reports.emplace_back(new MatchReport(*matcher));
+            scorers.back()->setReport(reports.back().get());
+        }
     }
-    toLower(text);
-    int score = 0;
-    for (auto it = spamMap.cbegin(); it != spamMap.cend(); it++)
+    auto score = [&scorers, &wordScorers](int worker, MappedFile& massageFile, int64_t& result)
     {
-        std::string phrase = it->first;
-        toLower(phrase);
-        size_t loc = text.find(phrase);
-        while (loc != std::string::npos)
+        if (!wordScorers.empty())
         {
-            score += it->second;
-            loc = text.find(phrase, loc + 1);
+            return scoreMassage(*wordScorers[worker], massageFile, result);
         }
+        return scoreMassage(*scorers[worker], massageFile, result);
+    };
+    std::vector<std::string> window;
+    bool scored = true;
+    bool found = forEachMassage(source, [&](const std::string& path)
+    {
+        window.push_back(path);
+        if (window.size() == BATCH_WINDOW)
+        {
+            scored = scoreWindow(window, score, reports, pool, threshold, sink) && scored;
+            window.clear();
+        }
+    });
+    scored = scoreWindow(window, score, reports, pool, threshold, sink) && scored;
+    std::cout.flush();
+    if (!found)
+    {
+        std::cerr << INVALID_INPUT_MSG << std::endl;
     }
-    return score;
+    else if (stats)
+    {
+        PrefilterStats total;
+        for (const std::unique_ptr<MessageScorer>& scorer : scorers)
+        {
+            total.add(scorer->prefilterStats());
+        }
+        std::cerr << STATS_MSG << total.rejected << STATS_OF_MSG << total.messages
+                  << STATS_MASSAGES_MSG << total.rejectRate() * PERCENT << STATS_SKIPPED_MSG
+                  << total.skipped << STATS_OF_MSG << total.bytes << STATS_BYTES_MSG
+                  << total.skipRate() * PERCENT << STATS_END_MSG << std::endl;
+    }
+    return found && scored ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Serve the spam checks of clients over a Unix domain socket, until SIGINT or SIGTERM.
+ * @param databasePath The path of the spam file or the compiled spam database.
+ * @param socketPath The path of the socket.
+ * @param thresholdArg The threshold argument.
+ * @param threads The number of threads that score the massages.
+ * @param massageRoot The directory of the massage files the clients may send paths of, or empty.
+ * @return EXIT_SUCCESS if the daemon stopped by a signal, EXIT_FAILURE otherwise.
+ */
+int runDaemon(const std::string& databasePath, const std::string& socketPath,
+              const std::string& thresholdArg, int threads, const std::string& massageRoot)
+{
+    int threshold;
+    if (!parsePositive(thresholdArg, threshold))
+    {
+        std::cerr << INVALID_INPUT_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+    try
+    {
+        SpamDaemon daemon(socketPath, databasePath, threshold, loadSharedDatabase, threads,
+                          massageRoot);
+        return daemon.run();
+    }
+    catch (const std::bad_alloc&)
+    {
+        std::cerr << MEMORY_MSG << std::endl;
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
+    return EXIT_FAILURE;
 }
 
 /**
- * Runs the whole program and print a spam/ not-spam massage.
+ * Runs the whole program and print a spam/ not-spam massage, or a line for every massage in batch
+ * mode, or compile a spam file, or serve clients in daemon mode.
  * @param argc The number of arguments.
  * @param argv An array of the arguments.
  * @return EXIT_SUCCESS if the program run successfully, EXIT_FAILURE otherwise.
  */
 int main(int argc, char *argv[])
 {
-    if (argc != ARGS_AMOUNT)
+    if (argc == ARGS_AMOUNT && argv[1] == COMPILE_FLAG)
+    {
+        return runCompile(argv[COMPILE_SPAM_ARG], argv[COMPILE_IMAGE_ARG]);
+    }
+    bool batch = false;
+    bool daemon = false;
+    bool stats = false;
+    bool words = false;
+    int threads = 1;
+    bool threadsGiven = false;
+    std::string reportPath;
+    std::string massageRoot;
+    bool validArgs = true;
+    while (argc > ARGS_AMOUNT && validArgs)
+    {
+        if (argv[1] == BATCH_FLAG)
+        {
+            batch = true;
+            argc--;
+            argv++;
+        }
+        else if (argv[1] == DAEMON_FLAG)
+        {
+            daemon = true;
+            argc--;
+            argv++;
+        }
+        else if (argv[1] == STATS_FLAG)
+        {
+            stats = true;
+            argc--;
+            argv++;
+        }
+        else if (argv[1] == WORDS_FLAG)
+        {
+            words = true;
+            argc--;
+            argv++;
+        }
+        else if (argv[1] == THREADS_FLAG && argc > ARGS_AMOUNT + 1)
+        {
+            validArgs = parseThreads(argv[2], threads);
+            threadsGiven = true;
+            argc -= 2;
+            argv += 2;
+        }
+        else if (argv[1] == REPORT_FLAG && argc > ARGS_AMOUNT + 1)
+        {
+            reportPath = argv[2];
+            validArgs = !reportPath.empty();
+            argc -= 2;
+            argv += 2;
+        }
+        else if (argv[1] == ROOT_FLAG && argc > ARGS_AMOUNT + 1)
+        {
+            massageRoot = argv[2];
+            validArgs = !massageRoot.empty();
+            argc -= 2;
+            argv += 2;
+        }
+        else
+        {
+            validArgs = false;
+        }
+    }
+    // Every flag must have an effect in the mode: -j only in batch and daemon modes, -r only in
+    // daemon mode, -s only in batch mode, and -w without -e or -s.
+    if (!validArgs || argc != ARGS_AMOUNT || (daemon && (batch || !reportPath.empty() || words)) ||
+        (threadsGiven && !batch && !daemon) || (!massageRoot.empty() && !daemon) ||
+        (stats && (!batch || words)) || (words && !reportPath.empty()))
     {
         std::cerr << USAGE_MSG << std::endl;
         return EXIT_FAILURE;
     }
-    std::ifstream spamFile(argv[SPAM_FILE_ARG]), massageFile(argv[MSG_FILE_ARG]);
-    std::string strThreshold = argv[THRESHOLD_ARG];
-    size_t end;
-    int threshold = std::stoi(strThreshold, &end);
-    if (!spamFile || !massageFile || end != strThreshold.length() || threshold <= 0)
+    if (daemon)
+    {
+        return runDaemon(argv[SPAM_FILE_ARG], argv[SOCKET_ARG], argv[THRESHOLD_ARG], threads,
+                         massageRoot);
+    }
+    MappedFile spamFile(argv[SPAM_FILE_ARG]);
+    int threshold;
+    if (!spamFile || !parsePositive(argv[THRESHOLD_ARG], threshold))
     {
         std::cerr << INVALID_INPUT_MSG << std::endl;
         return EXIT_FAILURE;
     }
-    int score;
+    ReportSink sink;
+    if (!reportPath.empty())
+    {
+        sink.file.open(reportPath);
+        sink.format = reportPath.size() >= JSON_EXTENSION.size() &&
+                      reportPath.compare(reportPath.size() - JSON_EXTENSION.size(),
+                                         JSON_EXTENSION.size(), JSON_EXTENSION) == 0 ?
+                      REPORT_JSON : REPORT_TSV;
+        if (!sink.file)
+        {
+            std::cerr << REPORT_FAILED_MSG << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    ReportSink *report = reportPath.empty() ? nullptr : &sink;
+    bool spam;
     try
     {
-        HashMap<std::string, int> spamMap;
-        parseSpamFile(spamFile, spamMap);
-        score = checkSpam(massageFile, spamMap);
+        if (words)
+        {
+            WordMatcher index = loadWords(std::move(spamFile));
+            if (batch)
+            {
+                return runBatch(argv[MSG_FILE_ARG], nullptr, threshold, threads, nullptr, false,
+                                &index);
+            }
+            MappedFile massageFile = openMassage(argv[MSG_FILE_ARG]);
+            spam = checkWords(massageFile, index, threshold);
+        }
+        else
+        {
+            AhoCorasick matcher = loadDatabase(std::move(spamFile));
+            if (batch)
+            {
+                return runBatch(argv[MSG_FILE_ARG], &matcher, threshold, threads, report, stats,
+                                nullptr);
+            }
+            MappedFile massageFile = openMassage(argv[MSG_FILE_ARG]);
+            spam = report == nullptr ? checkSpam(massageFile, matcher, threshold) :
+                   explainSpam(massageFile, argv[MSG_FILE_ARG], matcher, threshold, *report);
+        }
     }
     catch (const std::bad_alloc&)
     {
         std::cerr << MEMORY_MSG << std::endl;
         return EXIT_FAILURE;
     }
-    catch (const std::invalid_argument&)
+    catch (const std::invalid_argument& e)
     {
-        std::cerr << INVALID_INPUT_MSG << std::endl;
+        std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
     }
-    if (score >= threshold)
+    if (spam)
     {
         std::cout << SPAM_MSG << std::endl;
     }
@@ -166,4 +963,3 @@ int main(int argc, char *argv[])
     }
     return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,459 @@
+#ifndef EX3_WORDMATCHER_HPP
+#define EX3_WORDMATCHER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "HashMap.hpp"
+#include "AhoCorasick.hpp"
+#include "Simd.hpp"
+#include "MessageScorer.hpp"
+
+/**
+ * Defines the separator of the words of a normalized phrase or message.
+ */
+const char WORD_SEPARATOR = ' ';
+/**
+ * Defines the number of words of a message whose windows a scorer looks up in the index together.
+ */
+const size_t WORD_LOOKUP_BATCH = 256;
+
+/**
+ * @param c A normalized byte (see normalizeByte).
+ * @return True if the byte is a part of a word: an ASCII letter or digit, or a non-ASCII byte (of a
+ * UTF-8 letter), false if it separates words.
+ */
+inline bool isWordByte(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+/**
+ * Append the words of the given text to a buffer: every word in lower case, after a
+ * WORD_SEPARATOR if it isn't the first word of the buffer.
+ * @param text The text.
+ * @param words The buffer.
+ * @param starts If not nullptr, gets the offset in the buffer of every appended word.
+ * @return The number of appended words.
+ */
+inline size_t appendWords(std::string_view text, std::string& words, std::vector<size_t> *starts)
+{
+    // Every byte adds at most itself and a separator before it.
+    size_t size = words.size();
+    words.resize(size + 2 * text.size());
+    char *out = &words[0];
+    size_t count = 0;
+    bool inWord = false;
+    for (char c : text)
+    {
+        unsigned char normal = normalizeByte((unsigned char) c);
+        if (!isWordByte(normal))
+        {
+            inWord = false;
+            continue;
+        }
+        if (!inWord)
+        {
+            if (size != 0)
+            {
+                out[size++] = WORD_SEPARATOR;
+            }
+            if (starts != nullptr)
+            {
+                starts->push_back(size);
+            }
+            inWord = true;
+            count++;
+        }
+        out[size++] = (char) normal;
+    }
+    words.resize(size);
+    return count;
+}
+
+/**
+ * An entry of the index of a WordMatcher, of the words of a phrase or of the first words of one.
+ */
+struct WordEntry
+{
+    // The total score of the phrases of these words, 0 if they are only the first words of some.
+    int64_t score;
+    // True if some longer phrase starts with these words.
+    bool extends;
+};
+
+/**
+ * The index of the spam phrases for whole word matching. A phrase matches only whole words of a
+ * message, so "class" matches "a class." but not "classic". A phrase and a message are both split
+ * to words (runs of ASCII letters, digits and non-ASCII bytes, in lower case), and the phrase
+ * matches every run of the same words in the message, whatever separates them. Every phrase is
+ * kept as its words joined by a single WORD_SEPARATOR, so looking up the phrases that start at a
+ * word of the message is one hash map lookup for every number of words up to the longest phrase,
+ * whatever the number of phrases is. The first words of every phrase are in the index too, so the
+ * lookups of a word stop at the first window no phrase starts with. A phrase with no words never
+ * matches.
+ */
+class WordMatcher
+{
+    // The words of all the phrases, that the keys of the index are views of.
+    std::string _words;
+    HashMap<std::string_view, WordEntry> _index;
+    size_t _maxWords;
+    size_t _maxLength;
+
+    /**
+     * Add the phrases to the index. Phrases with the same words share their key, and the sum of
+     * their scores.
+     * @param phrases The phrases and their scores, as pairs.
+     */
+    template <typename Map>
+    void _build(const Map& phrases)
+    {
+        size_t phraseBytes = 0;
+        for (const auto& phrase : phrases)
+        {
+            phraseBytes += 2 * phrase.first.size();
+        }
+        // The keys are views of _words, so it must never grow after this.
+        _words.reserve(phraseBytes);
+        _index.reserve((int) phrases.size());
+        std::string key;
+        std::vector<size_t> starts;
+        for (const auto& phrase : phrases)
+        {
+            key.clear();
+            starts.clear();
+            size_t words = appendWords(phrase.first, key, &starts);
+            if (words == 0)
+            {
+                continue;
+            }
+            _maxWords = std::max(_maxWords, words);
+            _maxLength = std::max(_maxLength, key.size());
+            auto found = _index.find(std::string_view(key));
+            if (found != _index.end())
+            {
+                found->second.score += phrase.second;
+                continue;
+            }
+            size_t start = _words.size();
+            _words += key;
+            std::string_view stored = std::string_view(_words).substr(start, key.size());
+            _index.try_emplace(stored, WordEntry{phrase.second, false});
+            for (size_t i = 1; i < words; i++)
+            {
+                _index.try_emplace(stored.substr(0, starts[i] - 1), WordEntry{0, false})
+                    .first->second.extends = true;
+            }
+        }
+    }
+
+public:
+
+    /**
+     * Build the index of the phrases of the given map.
+     * @param phrases Map of phrases and their scores, like HashMap<std::string, int>.
+     */
+    template <typename Map>
+    explicit WordMatcher(const Map& phrases) :
+        _maxWords(0),
+        _maxLength(0)
+    {
+        _build(phrases);
+    }
+
+    /**
+     * Build the index of the phrases of the given automaton, like one of a compiled spam database.
+     * @param matcher The automaton.
+     */
+    explicit WordMatcher(const AhoCorasick& matcher) :
+        _maxWords(0),
+        _maxLength(0)
+    {
+        std::vector<std::pair<std::string_view, int64_t>> phrases;
+        phrases.reserve(matcher.phrases());
+        for (size_t i = 0; i < matcher.phrases(); i++)
+        {
+            phrases.emplace_back(matcher.phrase(i), matcher.phraseScore(i));
+        }
+        _build(phrases);
+    }
+
+    WordMatcher(const WordMatcher&) = delete;
+    WordMatcher& operator=(const WordMatcher&) = delete;
+
+    /**
+     * @return The number of words of the longest phrase.
+     */
+    size_t maxWords() const
+    {
+        return _maxWords;
+    }
+
+    /**
+     * @return The number of bytes of the longest phrase, as its words joined by WORD_SEPARATOR.
+     */
+    size_t maxLength() const
+    {
+        return _maxLength;
+    }
+
+    /**
+     * @return The index of the phrases, from their words joined by WORD_SEPARATOR to their score.
+     */
+    const HashMap<std::string_view, WordEntry>& index() const
+    {
+        return _index;
+    }
+
+};
+
+/**
+ * Scores messages by the whole words of a WordMatcher. A message can be given in parts, and it is
+ * split to words one SCAN_BLOCK at a time. The windows that start at the words of a block are
+ * looked up once they have all their words, a batch of words at a time, one number of words at a
+ * time, and a window is extended by another word only if some phrase starts with it. Only the last
+ * maxWords() - 1 words (and the word the last part ended in) are kept for the next block, and a
+ * word is kept only up to one byte longer than the longest phrase (that is already too long to
+ * match), so a message is scored in a constant amount of memory. A scorer keeps its buffers between
+ * the messages, so it is made to be reused for the messages of one thread.
+ */
+class WordScorer
+{
+    const WordMatcher& _matcher;
+    // The words of the message that windows still start at, joined by WORD_SEPARATOR.
+    std::string _words;
+    // The offset of every word of _words.
+    std::vector<size_t> _starts;
+    // True if the last part ended in the last word of _words, that the next part can go on with.
+    bool _inWord;
+    // The first words of the windows that are looked up, and of the ones that are extended next.
+    std::vector<size_t> _firsts;
+    std::vector<size_t> _extended;
+    std::vector<std::string_view> _windows;
+    int64_t _score;
+
+    /**
+     * The output iterator of find_many, that adds the score of every window that was found, and
+     * keeps the windows that can be extended.
+     */
+    struct WindowVisitor
+    {
+        WordScorer& scorer;
+        size_t window;
+
+        WindowVisitor& operator*()
+        {
+            return *this;
+        }
+
+        WindowVisitor& operator++(int)
+        {
+            return *this;
+        }
+
+        template <typename Iterator>
+        WindowVisitor& operator=(const Iterator& found)
+        {
+            if (found != scorer._matcher.index().end())
+            {
+                scorer._score += found->second.score;
+                if (found->second.extends)
+                {
+                    scorer._extended.push_back(scorer._firsts[window]);
+                }
+            }
+            window++;
+            return *this;
+        }
+    };
+
+    /**
+     * Split the given bytes of the message to words, and append them to _words.
+     * @param data The bytes.
+     * @param length The number of bytes.
+     */
+    void _appendWords(const char *data, size_t length)
+    {
+        // Every byte adds at most itself and a separator before it.
+        size_t size = _words.size();
+        _words.resize(size + 2 * length);
+        char *out = &_words[0];
+        size_t longest = _matcher.maxLength();
+        for (size_t i = 0; i < length; i++)
+        {
+            unsigned char normal = normalizeByte((unsigned char) data[i]);
+            if (!isWordByte(normal))
+            {
+                _inWord = false;
+                continue;
+            }
+            if (!_inWord)
+            {
+                if (size != 0)
+                {
+                    out[size++] = WORD_SEPARATOR;
+                }
+                _starts.push_back(size);
+                _inWord = true;
+            }
+            if (size - _starts.back() <= longest)
+            {
+                out[size++] = (char) normal;
+            }
+        }
+        _words.resize(size);
+    }
+
+    /**
+     * Add the scores of all the windows that start at the words in _firsts.
+     * @param words The number of words the windows can have, that _starts has one more offset
+     * than.
+     */
+    void _scoreWindows(size_t words)
+    {
+        const HashMap<std::string_view, WordEntry>& index = _matcher.index();
+        std::string_view text(_words);
+        for (size_t length = 1; length <= _matcher.maxWords() && !_firsts.empty(); length++)
+        {
+            _windows.clear();
+            _extended.clear();
+            size_t kept = 0;
+            for (size_t first : _firsts)
+            {
+                if (first + length <= words)
+                {
+                    _firsts[kept++] = first;
+                    size_t start = _starts[first];
+                    _windows.push_back(text.substr(start, _starts[first + length] - 1 - start));
+                }
+            }
+            _firsts.resize(kept);
+            index.find_many(_windows.data(), (int) _windows.size(), WindowVisitor{*this, 0});
+            _firsts.swap(_extended);
+        }
+    }
+
+    /**
+     * Add the scores of the windows that start at the words that have all the words of their
+     * windows, and drop the words no window starts at anymore.
+     * @param end True if the message ended, so its last word is whole and every window can be
+     * scored, false otherwise.
+     */
+    void _scoreWords(bool end)
+    {
+        size_t words = _starts.size() - (_inWord && !end);
+        size_t ready = words;
+        if (!end)
+        {
+            ready = words < _matcher.maxWords() ? 0 : words - _matcher.maxWords() + 1;
+        }
+        // The end of the last whole word, as if another word followed it.
+        bool last = words == _starts.size();
+        if (last)
+        {
+            _starts.push_back(_words.size() + 1);
+        }
+        for (size_t first = 0; first < ready; first += WORD_LOOKUP_BATCH)
+        {
+            _firsts.clear();
+            for (size_t i = first; i < std::min(ready, first + WORD_LOOKUP_BATCH); i++)
+            {
+                _firsts.push_back(i);
+            }
+            _scoreWindows(words);
+        }
+        if (last)
+        {
+            _starts.pop_back();
+        }
+        if (ready == _starts.size())
+        {
+            _words.clear();
+            _starts.clear();
+            return;
+        }
+        size_t dropped = _starts[ready];
+        _words.erase(0, dropped);
+        _starts.erase(_starts.begin(), _starts.begin() + (std::ptrdiff_t) ready);
+        for (size_t& start : _starts)
+        {
+            start -= dropped;
+        }
+    }
+
+public:
+
+    /**
+     * Constructor.
+     * @param matcher The index of the spam phrases, that must live longer than the scorer.
+     */
+    explicit WordScorer(const WordMatcher& matcher) :
+        _matcher(matcher),
+        _inWord(false),
+        _score(0)
+    {
+    }
+
+    /**
+     * Start a new message.
+     */
+    void reset()
+    {
+        _words.clear();
+        _starts.clear();
+        _inWord = false;
+        _score = 0;
+    }
+
+    /**
+     * Score the next part of the message.
+     * @param data The bytes of the part, as they are in the message file.
+     * @param length The number of bytes.
+     */
+    void feed(const char *data, size_t length)
+    {
+        if (_matcher.maxWords() == 0)
+        {
+            return;
+        }
+        while (length > 0)
+        {
+            size_t count = std::min(length, SCAN_BLOCK);
+            _appendWords(data, count);
+            _scoreWords(false);
+            data += count;
+            length -= count;
+        }
+    }
+
+    /**
+     * End the message. Call it once, after all the parts were fed.
+     * @return The score of the whole message: the sum of the scores of all the runs of whole words
+     * of the message that are phrases, overlapping ones included.
+     */
+    int64_t finish()
+    {
+        _scoreWords(true);
+        int64_t score = _score;
+        reset();
+        return score;
+    }
+
+    /**
+     * Score a whole message, like feeding it and finishing it.
+     * @param message The message.
+     * @return The score of the message.
+     */
+    int64_t score(std::string_view message)
+    {
+        reset();
+        feed(message.data(), message.size());
+        return finish();
+    }
+
+};
+
+#endif //EX3_WORDMATCHER_HPP
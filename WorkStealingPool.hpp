@@ -0,0 +1,235 @@
+#ifndef EX3_WORKSTEALINGPOOL_HPP
+#define EX3_WORKSTEALINGPOOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/**
+ * Defines the alignment of every worker's queue, so two queues never share a cache line.
+ */
+const int QUEUE_ALIGN = 64;
+/**
+ * Defines a massage for an invalid number of threads.
+ */
+const char* INVALID_THREADS = "Invalid number of threads";
+
+/**
+ * A fixed pool of threads that run the tasks of a job by work stealing.
+ * The tasks of a job are numbered, and every worker starts with a consecutive range of them in its
+ * own queue. A worker takes tasks from the front of its queue, and when it's empty it steals from
+ * the back of the other workers' queues, so workers that got slow tasks are helped by the others.
+ * The thread that runs a job is one of the workers, so a pool of one worker runs the job without
+ * any other thread. A task that throws doesn't stop its worker: the first exception of a job is
+ * kept, and is thrown by run once all the tasks of the job are done.
+ */
+class WorkStealingPool
+{
+    /**
+     * The queue of tasks of a worker.
+     */
+    struct alignas(QUEUE_ALIGN) Queue
+    {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    int _workers;
+    std::unique_ptr<Queue[]> _queues;
+    std::vector<std::thread> _threads;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    std::function<void(size_t, int)> _task;
+    size_t _job;
+    int _busy;
+    bool _stop;
+    // The first exception a task of the current job threw.
+    std::exception_ptr _error;
+
+    /**
+     * @param worker The index of a worker.
+     * @param task Set to the task the worker should run next.
+     * @return True if a task was found, false if all the queues are empty.
+     */
+    bool _take(int worker, size_t& task)
+    {
+        {
+            Queue& own = _queues[worker];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty())
+            {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (int i = 1; i < _workers; i++)
+        {
+            Queue& victim = _queues[(worker + i) % _workers];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Run tasks of the current job until there are none left.
+     * @param worker The index of the worker.
+     */
+    void _work(int worker)
+    {
+        size_t task;
+        while (_take(worker, task))
+        {
+            try
+            {
+                _task(task, worker);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                if (!_error)
+                {
+                    _error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    /**
+     * The loop of a pool thread, that works on every job until the pool is destroyed.
+     * @param worker The index of the worker of the thread.
+     */
+    void _threadLoop(int worker)
+    {
+        size_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> guard(_lock);
+                _wake.wait(guard, [&] { return _stop || _job != seen; });
+                if (_stop)
+                {
+                    return;
+                }
+                seen = _job;
+            }
+            _work(worker);
+            std::lock_guard<std::mutex> guard(_lock);
+            if (--_busy == 0)
+            {
+                _done.notify_one();
+            }
+        }
+    }
+
+public:
+
+    /**
+     * Constructor. If the number of workers isn't positive, it will throw an exception.
+     * @param workers The number of workers, including the thread that runs the jobs.
+     */
+    explicit WorkStealingPool(int workers) :
+        _workers(workers),
+        _job(0),
+        _busy(0),
+        _stop(false)
+    {
+        if (workers <= 0)
+        {
+            throw std::invalid_argument(INVALID_THREADS);
+        }
+        _queues.reset(new Queue[workers]);
+        for (int i = 1; i < workers; i++)
+        {
+            _threads.emplace_back(&WorkStealingPool::_threadLoop, this, i);
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * Destructor. Stops and joins all the threads of the pool.
+     */
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (std::thread& thread : _threads)
+        {
+            thread.join();
+        }
+    }
+
+    /**
+     * @return The number of workers of the pool.
+     */
+    int workers() const
+    {
+        return _workers;
+    }
+
+    /**
+     * Run a job of the given number of tasks, and return when all of them are done. The tasks may
+     * run in any order and on any worker. If any task threw, the first exception is thrown once
+     * all the other tasks are done.
+     * @param tasks The number of tasks.
+     * @param task A function that gets the index of a task and the index of the worker that runs
+     * it, so it can use per-worker state.
+     */
+    void run(size_t tasks, const std::function<void(size_t, int)>& task)
+    {
+        if (tasks == 0)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _task = task;
+        }
+        for (int i = 0; i < _workers; i++)
+        {
+            std::lock_guard<std::mutex> guard(_queues[i].lock);
+            for (size_t t = tasks * i / _workers; t < tasks * (i + 1) / _workers; t++)
+            {
+                _queues[i].tasks.push_back(t);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _busy = _workers - 1;
+            _job++;
+        }
+        _wake.notify_all();
+        _work(0);
+        std::unique_lock<std::mutex> guard(_lock);
+        _done.wait(guard, [&] { return _busy == 0; });
+        if (_error)
+        {
+            std::exception_ptr error = _error;
+            _error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+};
+
+#endif //EX3_WORKSTEALINGPOOL_HPP
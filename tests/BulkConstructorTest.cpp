@@ -0,0 +1,68 @@
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../HashMap.hpp"
+
+/**
+ * Defines the largest number of pairs the constructors of the test get.
+ */
+const int MAX_PAIRS = 200;
+/**
+ * Defines the numbers of different keys the pairs of the test repeat.
+ */
+const int KEY_COUNTS[] = {1, 5, 12, 13, 50};
+
+/**
+ * Check that a map of a bulk constructor equals the map its pairs are inserted to one at a time.
+ * @param name The name of the constructor.
+ * @param built The map of the constructor.
+ * @param inserted The map of the inserts.
+ * @return 1 if they differ, 0 otherwise.
+ */
+int compare(const char *name, const HashMap<std::string, int>& built,
+            const HashMap<std::string, int>& inserted)
+{
+    if (built.capacity() == inserted.capacity() && built == inserted)
+    {
+        return 0;
+    }
+    std::cerr << name << " constructor: " << built.size() << " keys with capacity "
+              << built.capacity() << " instead of " << inserted.capacity() << std::endl;
+    return 1;
+}
+
+/**
+ * Test that the vector and range constructors end with the capacity of a map their pairs were
+ * inserted to one at a time, also when the pairs repeat keys, so the maps are equal.
+ * @return 0 if the test passed, 1 otherwise.
+ */
+int main()
+{
+    int failures = 0;
+    for (int keyCount : KEY_COUNTS)
+    {
+        for (int pairs = 1; pairs <= MAX_PAIRS; pairs++)
+        {
+            std::vector<std::string> keys;
+            std::vector<int> values;
+            std::vector<std::pair<std::string, int>> range;
+            HashMap<std::string, int> inserted;
+            for (int i = 0; i < pairs; i++)
+            {
+                keys.push_back("key" + std::to_string(i % keyCount));
+                values.push_back(i);
+                range.emplace_back(keys.back(), i);
+                inserted[keys.back()] = i;
+            }
+            failures += compare("vectors", HashMap<std::string, int>(keys, values), inserted);
+            failures += compare("range", HashMap<std::string, int>(range.begin(), range.end()),
+                                inserted);
+            failures += compare("moved vectors",
+                                HashMap<std::string, int>(std::move(keys), std::move(values)),
+                                inserted);
+        }
+    }
+    std::cout << (failures == 0 ? "ok" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
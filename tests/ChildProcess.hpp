@@ -0,0 +1,129 @@
+#ifndef EX3_CHILDPROCESS_HPP
+#define EX3_CHILDPROCESS_HPP
+
+#include <csignal>
+#include <string>
+#include <fcntl.h>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * What a program that a test ran did.
+ */
+struct ChildResult
+{
+    // The standard output of the program.
+    std::string output;
+    // The exit status of the program, as waitpid gives it, or -1 if it couldn't run.
+    int status = -1;
+    // The peak resident memory of the program, in kilobytes.
+    long maxRssKb = 0;
+};
+
+/**
+ * Write the given bytes to a file descriptor.
+ * @param fd The file descriptor.
+ * @param data The bytes.
+ * @return True if all of them were written, false otherwise.
+ */
+inline bool writeAll(int fd, const std::string& data)
+{
+    size_t done = 0;
+    while (done < data.size())
+    {
+        ssize_t count = write(fd, data.data() + done, data.size() - done);
+        if (count <= 0)
+        {
+            return false;
+        }
+        done += (size_t) count;
+    }
+    return true;
+}
+
+/**
+ * Replace the current process with a program, or exit with 127 if it can't run.
+ * @param args The path of the program and its arguments.
+ */
+[[noreturn]] inline void execArgs(const std::vector<std::string>& args)
+{
+    std::vector<char *> argv;
+    for (const std::string& arg : args)
+    {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+}
+
+/**
+ * Start a program in the background, with its standard input and output on /dev/null.
+ * @param args The path of the program and its arguments.
+ * @return The process id of the program, or -1 if it couldn't be started.
+ */
+inline pid_t startChild(const std::vector<std::string>& args)
+{
+    pid_t child = fork();
+    if (child == 0)
+    {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        execArgs(args);
+    }
+    return child;
+}
+
+/**
+ * Run a program, give it the input the given function writes as its standard input, and wait for
+ * it to exit. The output of the program is read after the input is written, so it must be small.
+ * @param args The path of the program and its arguments.
+ * @param writeInput A function that gets the file descriptor of the standard input of the program
+ * and writes to it. The descriptor is closed after it returns.
+ * @return What the program did.
+ */
+template <typename F>
+ChildResult runChild(const std::vector<std::string>& args, F writeInput)
+{
+    ChildResult result;
+    int input[2];
+    int output[2];
+    if (pipe(input) != 0 || pipe(output) != 0)
+    {
+        return result;
+    }
+    pid_t child = fork();
+    if (child == 0)
+    {
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        close(input[1]);
+        close(output[0]);
+        execArgs(args);
+    }
+    close(input[0]);
+    close(output[1]);
+    // A program that stops reading its input early must not kill the test.
+    signal(SIGPIPE, SIG_IGN);
+    writeInput(input[1]);
+    close(input[1]);
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(output[0], buffer, sizeof(buffer))) > 0)
+    {
+        result.output.append(buffer, (size_t) count);
+    }
+    close(output[0]);
+    rusage usage = {};
+    if (wait4(child, &result.status, 0, &usage) != child)
+    {
+        result.status = -1;
+    }
+    result.maxRssKb = usage.ru_maxrss;
+    return result;
+}
+
+#endif //EX3_CHILDPROCESS_HPP
@@ -0,0 +1,161 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "../AhoCorasick.hpp"
+
+/**
+ * Defines the offset of the checksum in the header of a compiled spam database.
+ */
+const size_t CHECKSUM_OFFSET = 24;
+/**
+ * Defines the offset of the number of states in the header.
+ */
+const size_t STATES_OFFSET = 56;
+/**
+ * Defines the offset of the offsets and the sizes of the sections in the header.
+ */
+const size_t SECTIONS_OFFSET = 64;
+/**
+ * Defines the size of the header.
+ */
+const size_t HEADER_SIZE = SECTIONS_OFFSET + 14 * 2 * sizeof(uint64_t);
+
+/**
+ * A change of one element of a section of a compiled spam database.
+ */
+struct Corruption
+{
+    const char *name;
+    // The index of the section, in the order of AhoCorasick::Section.
+    int section;
+    // The size of an element of the section.
+    size_t elementSize;
+    // The element to change, counted from the end of the section if negative.
+    int64_t element;
+    // The new value, or states plus it if relative is true.
+    int64_t value;
+    bool relative;
+};
+
+/**
+ * Defines the corruptions of the test: every one of them puts an index out of its range or makes
+ * a link that doesn't lead up the trie, and must make the database be rejected.
+ */
+const Corruption CORRUPTIONS[] = {
+    {"an edge start past the edges", 0, 4, 1, 1 << 20, false},
+    {"an edge target past the states", 2, 4, 0, 5, true},
+    {"an edge target back to the root", 2, 4, 0, 0, false},
+    {"a failure link past the states", 3, 4, -1, 1, true},
+    {"a failure link to itself", 3, 4, -1, -1, true},
+    {"a root transition past the states", 5, 4, 'f', 0, true},
+    {"a byte class past the classes", 6, 1, 'f', 255, false},
+    {"a dense transition past the states", 7, 4, 3, 7, true},
+    {"a negative dense transition", 7, 4, 3, -7, false},
+    {"a phrase start past the text", 9, 8, 1, 1 << 30, false},
+    {"an output start past the outputs", 11, 4, 1, 1 << 20, false},
+    {"an output phrase past the phrases", 12, 4, 0, 1000, false},
+    {"an output link past the states", 13, 4, -1, 3, true},
+};
+
+/**
+ * @param image A compiled spam database.
+ * @return The checksum of its sections, like AhoCorasick computes it.
+ */
+uint64_t checksumOf(const std::string& image)
+{
+    uint64_t sum = image.size() - HEADER_SIZE;
+    for (size_t i = HEADER_SIZE; i < image.size(); i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, image.data() + i, sizeof(word));
+        sum = (sum ^ word) * HASH_MIX;
+        sum ^= sum >> 29;
+    }
+    return sum;
+}
+
+/**
+ * Write a database to a file and open it.
+ * @param path The path of the file.
+ * @param image The database.
+ * @return True if it was opened, false if it was rejected.
+ */
+bool opens(const std::string& path, const std::string& image)
+{
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << image;
+    try
+    {
+        AhoCorasick::open(MappedFile(path.c_str()));
+        return true;
+    }
+    catch (const std::invalid_argument&)
+    {
+        return false;
+    }
+}
+
+/**
+ * Test that opening a compiled spam database checks every index in it, so a database with an
+ * index out of its range, or with a failure link that doesn't lead up the trie, is rejected even
+ * if its checksum matches.
+ * @param argc 3.
+ * @param argv The path of SpamDetector and a scratch directory.
+ * @return 0 if the test passed, 1 otherwise.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: CompiledImageTest <SpamDetector> <scratch directory>" << std::endl;
+        return 1;
+    }
+    std::string path = std::string(argv[2]) + "/spam.img";
+    HashMap<std::string, int> phrases;
+    phrases["free"] = 2;
+    phrases["free money"] = 5;
+    phrases["money"] = 1;
+    phrases["reef"] = 3;
+    int failures = 0;
+    // A database with a dense table, and one that only has the trie edges.
+    for (int64_t denseLimit : {DEF_DENSE_LIMIT, (int64_t) 0})
+    {
+        std::ostringstream out;
+        AhoCorasick(phrases, denseLimit).save(out);
+        const std::string image = out.str();
+        if (!opens(path, image))
+        {
+            std::cerr << "a valid database was rejected" << std::endl;
+            failures++;
+        }
+        int32_t states;
+        std::memcpy(&states, image.data() + STATES_OFFSET, sizeof(states));
+        for (const Corruption& corruption : CORRUPTIONS)
+        {
+            uint64_t section[2];
+            std::memcpy(section, image.data() + SECTIONS_OFFSET + corruption.section *
+                        sizeof(section), sizeof(section));
+            if (section[1] == 0)
+            {
+                continue;
+            }
+            int64_t element = corruption.element < 0 ? (int64_t) section[1] + corruption.element :
+                              corruption.element;
+            int64_t value = corruption.value + (corruption.relative ? states : 0);
+            std::string corrupt = image;
+            std::memcpy(&corrupt[section[0] + (size_t) element * corruption.elementSize], &value,
+                        corruption.elementSize);
+            uint64_t checksum = checksumOf(corrupt);
+            std::memcpy(&corrupt[CHECKSUM_OFFSET], &checksum, sizeof(checksum));
+            if (opens(path, corrupt))
+            {
+                std::cerr << "a database with " << corruption.name << " was accepted"
+                          << (denseLimit == 0 ? " (without a dense table)" : "") << std::endl;
+                failures++;
+            }
+        }
+    }
+    std::cout << (failures == 0 ? "ok" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,288 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include "ChildProcess.hpp"
+#include "../SpamDaemon.hpp"
+
+/**
+ * Defines the most bytes of small requests the flooding client sends.
+ */
+const size_t FLOOD_BYTES = (size_t) 96 << 20;
+/**
+ * Defines the time in milliseconds after which a client that can't send or get anything is
+ * considered held back.
+ */
+const int STALL_MS = 1000;
+/**
+ * Defines the time in milliseconds the test waits for the socket of the daemon.
+ */
+const int START_MS = 10000;
+/**
+ * Defines the most memory the daemon may take, in kilobytes, which is much less than the flood.
+ */
+const long MAX_RSS_KB = 64 << 10;
+
+/**
+ * @param kind The kind of a request.
+ * @param payload The payload of the request.
+ * @return The bytes of the request.
+ */
+std::string request(char kind, const std::string& payload)
+{
+    uint32_t length = (uint32_t) payload.size();
+    return std::string{kind, (char) (length >> 24), (char) (length >> 16), (char) (length >> 8),
+                       (char) length} + payload;
+}
+
+/**
+ * @param path The path of the socket of the daemon.
+ * @return A socket connected to the daemon, or -1 if it couldn't connect.
+ */
+int connectTo(const std::string& path)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (const sockaddr *) &address, sizeof(address)) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/**
+ * Read the given number of bytes from a socket.
+ * @param fd The socket.
+ * @param size The number of bytes.
+ * @param data Set to the bytes that were read.
+ * @return True if all of them were read, false if the socket was closed or nothing came for
+ * STALL_MS.
+ */
+bool readBytes(int fd, size_t size, std::string& data)
+{
+    data.resize(size);
+    size_t done = 0;
+    pollfd wait = {fd, POLLIN, 0};
+    while (done < size && poll(&wait, 1, STALL_MS) == 1)
+    {
+        ssize_t count = read(fd, &data[done], size - done);
+        if (count <= 0)
+        {
+            break;
+        }
+        done += (size_t) count;
+    }
+    return done == size;
+}
+
+/**
+ * @param fd A socket connected to the daemon.
+ * @param response Set to the text of the next response.
+ * @return True if a response was read, false otherwise.
+ */
+bool readResponse(int fd, std::string& response)
+{
+    std::string header;
+    if (!readBytes(fd, RESPONSE_HEADER, header))
+    {
+        return false;
+    }
+    const unsigned char *bytes = (const unsigned char *) header.data();
+    size_t length = ((size_t) bytes[0] << 24) | ((size_t) bytes[1] << 16) |
+                    ((size_t) bytes[2] << 8) | (size_t) bytes[3];
+    return readBytes(fd, length, response);
+}
+
+/**
+ * @param pid The process id of a running program.
+ * @return The peak resident memory of the program in kilobytes, or 0 if it's unknown.
+ */
+long peakMemory(pid_t pid)
+{
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string field;
+    while (status >> field)
+    {
+        if (field == "VmHWM:")
+        {
+            long kilobytes = 0;
+            status >> kilobytes;
+            return kilobytes;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Send a few requests at once and check that their responses come in order.
+ * @param path The path of the socket of the daemon.
+ * @return The number of failures.
+ */
+int testPipelined(const std::string& path)
+{
+    const std::string massages[] = {"free money now", "money", "nothing to see"};
+    const std::string expected[] = {"8\tSPAM", "1\tNOT_SPAM", "0\tNOT_SPAM"};
+    int fd = connectTo(path);
+    std::string requests;
+    for (const std::string& massage : massages)
+    {
+        requests += request(REQUEST_MESSAGE, massage);
+    }
+    int failures = writeAll(fd, requests) ? 0 : 1;
+    for (const std::string& text : expected)
+    {
+        std::string response;
+        if (failures == 0 && (!readResponse(fd, response) || response != text))
+        {
+            std::cerr << "a pipelined request got \"" << response << "\" instead of \"" << text
+                      << "\"" << std::endl;
+            failures++;
+        }
+    }
+    close(fd);
+    return failures;
+}
+
+/**
+ * Flood the daemon with small requests without reading the responses, until the daemon stops
+ * reading them or FLOOD_BYTES were sent, then check the memory of the daemon, that another client
+ * is still served, and that every request of the flood gets its response.
+ * @param path The path of the socket of the daemon.
+ * @param daemon The process id of the daemon.
+ * @return The number of failures.
+ */
+int testFlood(const std::string& path, pid_t daemon)
+{
+    const std::string one = request(REQUEST_MESSAGE, "a");
+    std::string block;
+    while (block.size() < ((size_t) 1 << 20))
+    {
+        block += one;
+    }
+    int fd = connectTo(path);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    size_t sent = 0;
+    pollfd wait = {fd, POLLOUT, 0};
+    while (sent < FLOOD_BYTES)
+    {
+        ssize_t count = write(fd, block.data() + sent % block.size(),
+                              block.size() - sent % block.size());
+        if (count > 0)
+        {
+            sent += (size_t) count;
+        }
+        else if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            break;
+        }
+        else if (poll(&wait, 1, STALL_MS) != 1)
+        {
+            break;
+        }
+    }
+    int failures = 0;
+    long memory = peakMemory(daemon);
+    if (memory > MAX_RSS_KB)
+    {
+        std::cerr << "a client that sent " << (sent >> 20) << "MB without reading made the daemon"
+                  << " take " << memory << "KB" << std::endl;
+        failures++;
+    }
+    failures += testPipelined(path);
+    fcntl(fd, F_SETFL, 0);
+    shutdown(fd, SHUT_WR);
+    size_t requests = sent / one.size();
+    size_t answered = 0;
+    std::string response;
+    while (answered < requests && readResponse(fd, response) && response == "0\tNOT_SPAM")
+    {
+        answered++;
+    }
+    if (answered != requests)
+    {
+        std::cerr << "the flood got " << answered << " responses to " << requests << " requests"
+                  << std::endl;
+        failures++;
+    }
+    close(fd);
+    return failures;
+}
+
+/**
+ * Check that the daemon disconnects a client that sends a request longer than MAX_REQUEST.
+ * @param path The path of the socket of the daemon.
+ * @return The number of failures.
+ */
+int testOversized(const std::string& path)
+{
+    int fd = connectTo(path);
+    uint32_t length = MAX_REQUEST + 1;
+    std::string header{REQUEST_MESSAGE, (char) (length >> 24), (char) (length >> 16),
+                       (char) (length >> 8), (char) length};
+    pollfd wait = {fd, POLLIN, 0};
+    char byte;
+    int failures = 0;
+    if (!writeAll(fd, header) || poll(&wait, 1, STALL_MS) != 1 || read(fd, &byte, 1) != 0)
+    {
+        std::cerr << "a client that sent a request of " << length << " bytes wasn't disconnected"
+                  << std::endl;
+        failures++;
+    }
+    close(fd);
+    return failures;
+}
+
+/**
+ * Test that the daemon answers pipelined requests in order, that it buffers about one request for
+ * a client that sends without reading its responses instead of all of them, and that it
+ * disconnects a client whose request is too long.
+ * @param argc 3.
+ * @param argv The path of SpamDetector and a scratch directory.
+ * @return 0 if the test passed, 1 otherwise.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: DaemonBufferTest <SpamDetector> <scratch directory>" << std::endl;
+        return 1;
+    }
+    std::string database = std::string(argv[2]) + "/spam.csv";
+    std::string path = std::string(argv[2]) + "/spam.sock";
+    std::ofstream(database) << "free,2\nfree money,5\nmoney,1\n";
+    signal(SIGPIPE, SIG_IGN);
+    pid_t daemon = startChild({argv[1], "-d", database, path, "5"});
+    int fd = -1;
+    for (int waited = 0; daemon > 0 && fd < 0 && waited < START_MS; waited += 10)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        fd = connectTo(path);
+    }
+    if (fd < 0)
+    {
+        std::cerr << "the daemon didn't start" << std::endl;
+        std::cout << "FAILED" << std::endl;
+        return 1;
+    }
+    close(fd);
+    int failures = testPipelined(path);
+    failures += testFlood(path, daemon);
+    failures += testOversized(path);
+    kill(daemon, SIGTERM);
+    int status = -1;
+    waitpid(daemon, &status, 0);
+    if (status != 0 || access(path.c_str(), F_OK) == 0)
+    {
+        std::cerr << "the daemon stopped with status " << status << " or left its socket"
+                  << std::endl;
+        failures++;
+    }
+    std::cout << (failures == 0 ? "ok" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
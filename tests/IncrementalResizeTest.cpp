@@ -0,0 +1,130 @@
+#include <iostream>
+#include <unordered_map>
+#include "../HashMap.hpp"
+
+/**
+ * Defines the steps of incremental resize that are tested.
+ */
+const int STEPS[] = {1, 2, 3, 4, 64};
+/**
+ * Defines the number of times the test grows a map and then shrinks it.
+ */
+const int ROUNDS = 12;
+/**
+ * Defines the most old slots an insert or an erase may move with the default load factors and a
+ * step smaller than it, whatever the size of the map.
+ */
+const uint64_t MAX_MIGRATED = 16;
+
+/**
+ * The map of the test, with the pairs it should have.
+ */
+struct Checked
+{
+    HashMap<int, int> map;
+    std::unordered_map<int, int> expected;
+    int failures = 0;
+
+    /**
+     * Run an insert or an erase, and fail if it started a resize before the previous one ended.
+     * @param key The key.
+     * @param insert True to insert the key, false to erase it.
+     */
+    void operate(int key, bool insert)
+    {
+        bool wasResizing = map.resizing();
+        int capacity = map.capacity();
+        if (insert)
+        {
+            map.insert(key, key);
+            expected.emplace(key, key);
+        }
+        else
+        {
+            map.erase(key);
+            expected.erase(key);
+        }
+        if (wasResizing && map.capacity() != capacity)
+        {
+            std::cerr << "resize started at capacity " << capacity
+                      << " before the previous one ended" << std::endl;
+            failures++;
+        }
+    }
+
+    /**
+     * Fail if the map doesn't have exactly the expected pairs.
+     */
+    void verify()
+    {
+        if (map.size() != (int) expected.size())
+        {
+            std::cerr << "size " << map.size() << " instead of " << expected.size() << std::endl;
+            failures++;
+        }
+        for (const auto& pair : expected)
+        {
+            if (!map.containsKey(pair.first) || map.at(pair.first) != pair.second)
+            {
+                std::cerr << "lost key " << pair.first << std::endl;
+                failures++;
+                return;
+            }
+        }
+    }
+};
+
+/**
+ * Grow a map and then shrink it right after every resize, the sequence that gives a resize the
+ * fewest operations to end in, and check how many old slots an operation moved.
+ * @param step The step of incremental resize.
+ * @return The number of failures.
+ */
+int testStep(int step)
+{
+    Checked checked;
+    checked.map.setIncrementalResize(step);
+    int next = 0;
+    for (int round = 1; round <= ROUNDS; round++)
+    {
+        // Grow to a capacity of 16 << round, shrink once, then grow again.
+        while (checked.map.capacity() < (DEF_CAPACITY << round))
+        {
+            checked.operate(next++, true);
+        }
+        int capacity = checked.map.capacity();
+        while (checked.map.capacity() == capacity)
+        {
+            checked.operate(checked.expected.begin()->first, false);
+        }
+        capacity = checked.map.capacity();
+        while (checked.map.capacity() == capacity)
+        {
+            checked.operate(next++, true);
+        }
+        checked.verify();
+    }
+    uint64_t migrated = checked.map.stats().maxMigrated;
+    if (migrated > std::max((uint64_t) step, MAX_MIGRATED))
+    {
+        std::cerr << "step " << step << " moved " << migrated << " slots at once" << std::endl;
+        checked.failures++;
+    }
+    return checked.failures;
+}
+
+/**
+ * Test that an incremental resize always ends before the next one starts, so no insert or erase
+ * moves a whole old index table.
+ * @return 0 if the test passed, 1 otherwise.
+ */
+int main()
+{
+    int failures = 0;
+    for (int step : STEPS)
+    {
+        failures += testStep(step);
+    }
+    std::cout << (failures == 0 ? "ok" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "../MatchReport.hpp"
+
+/**
+ * A text and the JSON string it should be written as.
+ */
+struct Case
+{
+    std::string text;
+    std::string json;
+};
+
+/**
+ * Defines the texts of the test: plain and escaped ASCII, valid UTF-8 of every length, and bytes
+ * that aren't valid UTF-8.
+ */
+const Case CASES[] = {
+    {"free money", "\"free money\""},
+    {"a\"b\\c", "\"a\\\"b\\\\c\""},
+    {std::string("tab\tnul\0", 8), "\"tab\\u0009nul\\u0000\""},
+    {"del\x7F", "\"del\\u007f\""},
+    {"caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80", "\"caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80\""},
+    // A lone continuation byte, a cut sequence, an overlong encoding, a surrogate and a Latin-1
+    // byte.
+    {"\x80", "\"\\u0080\""},
+    {"\xE2\x82", "\"\\u00e2\\u0082\""},
+    {"\xC0\xAF", "\"\\u00c0\\u00af\""},
+    {"\xED\xA0\x80", "\"\\u00ed\\u00a0\\u0080\""},
+    {"caf\xE9!", "\"caf\\u00e9!\""},
+};
+
+/**
+ * Test that writeJsonString writes valid JSON for any bytes.
+ * @return 0 if the test passed, 1 otherwise.
+ */
+int main()
+{
+    int failures = 0;
+    for (const Case& test : CASES)
+    {
+        std::ostringstream out;
+        writeJsonString(out, test.text);
+        if (out.str() != test.json)
+        {
+            std::cerr << "wrote " << out.str() << " instead of " << test.json << std::endl;
+            failures++;
+        }
+    }
+    std::cout << (failures == 0 ? "ok" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
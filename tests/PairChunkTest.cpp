@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include "../AhoCorasick.hpp"
+
+/**
+ * Defines the bytes the phrases of the test start with: more than PREFILTER_MAX_BYTES of them, so
+ * the scan tests pairs of bytes without the SIMD search, and no letters, so few pairs are tested.
+ */
+const std::string FIRST_BYTES = "0123456789!#$%&*+";
+/**
+ * Defines the number of bytes of the texts that are timed.
+ */
+const size_t TEXT_BYTES = 16 << 20;
+/**
+ * Defines the number of bytes between two hits of the timed text, so most of its hits are found
+ * by the chunks and not by the pairs that are tested one by one.
+ */
+const size_t HIT_GAP = 44;
+/**
+ * Defines the number of times every text is timed, the fastest one counts.
+ */
+const int TIMINGS = 7;
+/**
+ * Defines how many times slower a text with a hit in most chunks may be than a text with none. If
+ * the scan tests a chunk again for every byte before its hit, it's more than 4 times slower.
+ */
+const double MAX_SLOWDOWN = 3;
+/**
+ * Defines the number of random texts the scores are compared on.
+ */
+const int TEXTS = 20000;
+
+/**
+ * @param matcher An automaton.
+ * @param text A text in lower case.
+ * @return The fastest time of a scan of the text, in nanoseconds.
+ */
+int64_t scanTime(const AhoCorasick& matcher, const std::string& text)
+{
+    int64_t best = INT64_MAX;
+    for (int i = 0; i < TIMINGS; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        int32_t state = ROOT_STATE;
+        volatile int64_t score = matcher.scan(text.data(), text.size(), state);
+        (void) score;
+        best = std::min(best, (int64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+/**
+ * Test that a scan in the root state that tests the pairs of bytes many at a time jumps straight
+ * to the first pair of a chunk that may start a phrase, instead of testing the chunk again for
+ * every byte before it, and that the jumps don't change the score.
+ * @return 0 if the test passed, 1 otherwise.
+ */
+int main()
+{
+    HashMap<std::string, int> phrases;
+    for (char first : FIRST_BYTES)
+    {
+        phrases[std::string(1, first) + "q"] = 2;
+        phrases[std::string(1, first) + "qx"] = 1;
+    }
+    // Without a dense table the pairs are tested; with the default one they aren't.
+    AhoCorasick matcher(phrases, 0);
+    AhoCorasick reference(phrases);
+    int failures = 0;
+    std::mt19937 random(2020);
+    const std::string bytes = "zzzzzzzzzq0x!";
+    for (int t = 0; t < TEXTS && failures == 0; t++)
+    {
+        std::string text;
+        for (size_t i = random() % 200; i > 0; i--)
+        {
+            text += bytes[random() % bytes.size()];
+        }
+        if (matcher.score(text) != reference.score(text))
+        {
+            std::cerr << "\"" << text << "\" scored " << matcher.score(text) << " instead of "
+                      << reference.score(text) << std::endl;
+            failures++;
+        }
+    }
+
+    std::string quiet(TEXT_BYTES, 'z');
+    std::string hits;
+    while (hits.size() < TEXT_BYTES)
+    {
+        hits += std::string(HIT_GAP, 'z') + "0q";
+    }
+    double slowdown = (double) scanTime(matcher, hits) / (double) scanTime(matcher, quiet);
+    if (slowdown > MAX_SLOWDOWN)
+    {
+        std::cerr << "a text with a hit every " << HIT_GAP + 2 << " bytes is scanned " << slowdown
+                  << " times slower than a text with none" << std::endl;
+        failures++;
+    }
+    std::cout << (failures == 0 ? "ok" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
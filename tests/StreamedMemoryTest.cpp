@@ -0,0 +1,86 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "ChildProcess.hpp"
+
+/**
+ * Defines the number of bytes of the massage that is piped to the program.
+ */
+const size_t MASSAGE_BYTES = (size_t) 128 << 20;
+/**
+ * Defines the line the massage repeats.
+ */
+const std::string MASSAGE_LINE = "hello there, this line says hello twice\n";
+/**
+ * Defines the most memory the program may take, in kilobytes, which is much less than the massage.
+ */
+const long MAX_RSS_KB = 32 << 10;
+
+/**
+ * Pipe a large massage that never reaches the threshold to SpamDetector, so it's read to its end,
+ * and check its answer and its peak memory.
+ * @param program The path of SpamDetector.
+ * @param database The path of the spam database.
+ * @param mode A flag of the mode, or an empty string for the automaton.
+ * @return The number of failures.
+ */
+int testPipe(const std::string& program, const std::string& database, const std::string& mode)
+{
+    std::vector<std::string> args = {program};
+    if (!mode.empty())
+    {
+        args.push_back(mode);
+    }
+    args.insert(args.end(), {database, "/dev/stdin", "2000000000"});
+    std::string block;
+    while (block.size() < ((size_t) 1 << 20))
+    {
+        block += MASSAGE_LINE;
+    }
+    ChildResult result = runChild(args, [&block](int fd)
+    {
+        for (size_t written = 0; written < MASSAGE_BYTES; written += block.size())
+        {
+            if (!writeAll(fd, block))
+            {
+                return;
+            }
+        }
+    });
+    std::string name = mode.empty() ? "automaton" : mode;
+    if (result.status != 0 || result.output != "NOT_SPAM\n")
+    {
+        std::cerr << name << ": status " << result.status << ", output \"" << result.output
+                  << "\"" << std::endl;
+        return 1;
+    }
+    if (result.maxRssKb > MAX_RSS_KB)
+    {
+        std::cerr << name << ": a piped massage of " << (MASSAGE_BYTES >> 20) << "MB took "
+                  << result.maxRssKb << "KB" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Test that a massage that can't be mapped (here, the standard input) is scored in parts, by the
+ * automaton and in the word mode, so the memory the program takes doesn't grow with the massage.
+ * @param argc 3.
+ * @param argv The path of SpamDetector and a scratch directory.
+ * @return 0 if the test passed, 1 otherwise.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: StreamedMemoryTest <SpamDetector> <scratch directory>" << std::endl;
+        return 1;
+    }
+    std::string database = std::string(argv[2]) + "/spam.csv";
+    std::ofstream(database) << "hello,1\nsays hello,2\n";
+    int failures = testPipe(argv[1], database, "");
+    failures += testPipe(argv[1], database, "-w");
+    std::cout << (failures == 0 ? "ok" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Defines the milliseconds the program gets to answer before the test fails.
+ */
+const int ANSWER_TIMEOUT_MS = 5000;
+
+/**
+ * Run SpamDetector on a massage that is given on a pipe that is never closed, and read its answer.
+ * @param program The path of SpamDetector.
+ * @param database The path of the spam database.
+ * @param massage The beginning of the massage that is written to the pipe.
+ * @param threshold The threshold.
+ * @return The output of the program, or an empty string if it didn't answer in time.
+ */
+std::string answerOfOpenPipe(const char *program, const std::string& database,
+                             const std::string& massage, const char *threshold)
+{
+    int input[2];
+    int output[2];
+    if (pipe(input) != 0 || pipe(output) != 0)
+    {
+        return "";
+    }
+    pid_t child = fork();
+    if (child == 0)
+    {
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        close(input[1]);
+        close(output[0]);
+        execl(program, program, database.c_str(), "/dev/stdin", threshold, (char *) nullptr);
+        _exit(127);
+    }
+    close(input[0]);
+    close(output[1]);
+    // The write end of the massage stays open, so the massage never ends.
+    if (write(input[1], massage.data(), massage.size()) != (ssize_t) massage.size())
+    {
+        return "";
+    }
+    std::string answer;
+    pollfd ready = {output[0], POLLIN, 0};
+    char buffer[256];
+    while (poll(&ready, 1, ANSWER_TIMEOUT_MS) == 1)
+    {
+        ssize_t count = read(output[0], buffer, sizeof(buffer));
+        if (count <= 0)
+        {
+            break;
+        }
+        answer.append(buffer, (size_t) count);
+    }
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    close(input[1]);
+    close(output[0]);
+    return answer;
+}
+
+/**
+ * Test that a massage that is streamed from a pipe is read only until its verdict is known, so a
+ * pipe that never ends gets an answer as soon as the score reaches the threshold.
+ * @param argc 3.
+ * @param argv The path of SpamDetector and a scratch directory.
+ * @return 0 if the test passed, 1 otherwise.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: StreamedVerdictTest <SpamDetector> <scratch directory>" << std::endl;
+        return 1;
+    }
+    std::string database = std::string(argv[2]) + "/spam.csv";
+    std::ofstream(database) << "hello,3\nworld,2\n";
+    int failures = 0;
+    std::string answer = answerOfOpenPipe(argv[1], database, "hello hello world\n", "8");
+    if (answer != "SPAM\n")
+    {
+        std::cerr << "open pipe that reached the threshold: \"" << answer << "\"" << std::endl;
+        failures++;
+    }
+    std::cout << (failures == 0 ? "ok" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
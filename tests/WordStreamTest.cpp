@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "../WordMatcher.hpp"
+
+/**
+ * Defines the number of random massages of the test.
+ */
+const int MASSAGES = 2000;
+/**
+ * Defines the words the massages are made of, with a word longer than every phrase.
+ */
+const char* WORDS[] = {"free", "Money", "click", "win", "a", "prize", "caf\xC3\xA9", "now",
+                       "freemoney", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"};
+/**
+ * Defines the separators between the words of the massages.
+ */
+const char* SEPARATORS[] = {" ", "  ", ", ", ".\n", "\t", "-", "!\r\n"};
+
+/**
+ * @param text A text.
+ * @return The words of the text, in lower case.
+ */
+std::vector<std::string> splitWords(const std::string& text)
+{
+    std::vector<std::string> words;
+    std::string word;
+    for (char c : text)
+    {
+        unsigned char byte = (unsigned char) c;
+        if (std::isalnum(byte) || byte >= 0x80)
+        {
+            word += (char) std::tolower(byte);
+        }
+        else if (!word.empty())
+        {
+            words.push_back(word);
+            word.clear();
+        }
+    }
+    if (!word.empty())
+    {
+        words.push_back(word);
+    }
+    return words;
+}
+
+/**
+ * Score a massage by comparing every phrase to the words at every position of it.
+ * @param phrases The phrases and their scores.
+ * @param massage The massage.
+ * @return The score of the massage.
+ */
+int64_t naiveScore(const HashMap<std::string, int>& phrases, const std::string& massage)
+{
+    std::vector<std::string> words = splitWords(massage);
+    int64_t score = 0;
+    for (const auto& phrase : phrases)
+    {
+        std::vector<std::string> phraseWords = splitWords(phrase.first);
+        for (size_t i = 0; !phraseWords.empty() && i + phraseWords.size() <= words.size(); i++)
+        {
+            if (std::equal(phraseWords.begin(), phraseWords.end(), words.begin() + i))
+            {
+                score += phrase.second;
+            }
+        }
+    }
+    return score;
+}
+
+/**
+ * Test that the word mode scores a massage that is fed in parts of any sizes like the whole
+ * massage, including words and phrases that cross the parts and words longer than every phrase.
+ * @return 0 if the test passed, 1 otherwise.
+ */
+int main()
+{
+    HashMap<std::string, int> phrases;
+    phrases["free money"] = 5;
+    phrases["money"] = 1;
+    phrases["click"] = 2;
+    phrases["win a prize now"] = 7;
+    phrases["a prize"] = 3;
+    phrases["CAF\xC3\xA9"] = 4;
+    WordMatcher matcher(phrases);
+    WordScorer scorer(matcher);
+    std::mt19937 random(2020);
+    int failures = 0;
+    for (int m = 0; m < MASSAGES && failures == 0; m++)
+    {
+        std::string massage;
+        int words = (int) (random() % 40);
+        for (int w = 0; w < words; w++)
+        {
+            massage += WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+            massage += SEPARATORS[random() % (sizeof(SEPARATORS) / sizeof(SEPARATORS[0]))];
+        }
+        int64_t expected = naiveScore(phrases, massage);
+        int64_t whole = scorer.score(massage);
+        scorer.reset();
+        size_t maxPart = 1 + random() % 16;
+        for (size_t i = 0; i < massage.size(); )
+        {
+            size_t part = std::min(massage.size() - i, 1 + random() % maxPart);
+            scorer.feed(massage.data() + i, part);
+            i += part;
+        }
+        int64_t parts = scorer.finish();
+        if (whole != expected || parts != expected)
+        {
+            std::cerr << "\"" << massage << "\": " << whole << " whole and " << parts
+                      << " in parts instead of " << expected << std::endl;
+            failures++;
+        }
+    }
+    std::cout << (failures == 0 ? "ok" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
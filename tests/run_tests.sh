@@ -0,0 +1,31 @@
+#!/bin/sh
+# Build SpamDetector and every *Test.cpp of this directory, and run the tests. A test gets the path
+# of the SpamDetector program and of a scratch directory, prints "ok" and exits with 0 if it passed.
+# Usage: tests/run_tests.sh [build directory]
+
+TESTS=$(cd "$(dirname "$0")" && pwd)
+BUILD=${1:-$(mktemp -d)}
+CXX=${CXX:-g++}
+FLAGS="-std=c++17 -O2 -Wall -Wextra -pthread"
+mkdir -p "$BUILD" || exit 1
+$CXX $FLAGS "$TESTS/../SpamDetector.cpp" -o "$BUILD/SpamDetector" || exit 1
+
+failed=0
+for source in "$TESTS"/*Test.cpp
+do
+    name=$(basename "$source" .cpp)
+    scratch="$BUILD/$name.d"
+    rm -rf "$scratch" && mkdir -p "$scratch"
+    if ! $CXX $FLAGS -DHASHMAP_STATS "$source" -o "$BUILD/$name"
+    then
+        echo "$name: doesn't compile"
+        failed=$((failed + 1))
+    elif ! result=$("$BUILD/$name" "$BUILD/SpamDetector" "$scratch")
+    then
+        echo "$name: $result"
+        failed=$((failed + 1))
+    else
+        echo "$name: $result"
+    fi
+done
+[ $failed -eq 0 ]